@@ -24,13 +24,26 @@
 
 #include "extern.h"
 
+/*
+ * Sorting doesn't move articles until the order is known: it sorts
+ * these small keys, which hold only what comparison needs, then moves
+ * each article once into place.
+ */
+struct	sortkey {
+	time_t		 time; /* date of publication */
+	const char	*str; /* filename or title text */
+	size_t		 order; /* cmdline sort order */
+	size_t		 idx; /* index of article */
+	enum sort	 sort; /* overriden sort order */
+};
+
 /*
  * All sort types can have the order overriden on an article-specific
  * basis by the SORT_FIRST or SORT_LAST override being applied.
  * Return non-zero if we do this; zero to fall through to our sort.
  */
 static int
-cmpoverride(const struct article *s1, const struct article *s2)
+cmpoverride(const struct sortkey *s1, const struct sortkey *s2)
 {
 
 	if (s1->sort != s2->sort) {
@@ -42,133 +55,139 @@ cmpoverride(const struct article *s1, const struct article *s2)
 	return 0;
 }
 
+/*
+ * Break ties in "rc" by command-line order, then by position in the
+ * list, so sorting never depends on qsort(3) being stable.
+ */
+static int
+tiebreak(int rc, const struct sortkey *s1, const struct sortkey *s2)
+{
+
+	if (rc != 0)
+		return rc;
+	if (s1->order != s2->order)
+		return s1->order < s2->order ? -1 : 1;
+	return (s1->idx > s2->idx) - (s1->idx < s2->idx);
+}
+
 static int
 rcmdlinecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
+	const struct sortkey *s1 = p1, *s2 = p2;
 	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return s2->order - s1->order;
+	return tiebreak((s2->order > s1->order) -
+	    (s2->order < s1->order), s1, s2);
 }
 
 static int
 cmdlinecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
+	const struct sortkey *s1 = p1, *s2 = p2;
 	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return s1->order - s2->order;
+	return tiebreak((s1->order > s2->order) -
+	    (s1->order < s2->order), s1, s2);
 }
 
 static int
 rfilenamecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
+	const struct sortkey *s1 = p1, *s2 = p2;
 	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return strcmp(s2->src, s1->src);
+	return tiebreak(strcmp(s2->str, s1->str), s1, s2);
 }
 
 static int
 filenamecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
+	const struct sortkey *s1 = p1, *s2 = p2;
 	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return strcmp(s1->src, s2->src);
+	return tiebreak(strcmp(s1->str, s2->str), s1, s2);
 }
 
 static int
 rititlecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
-	const char	*t1, *t2;
-	int		 rc;
-
-	t1 = (s1->titletext == NULL) ? "" : s1->titletext;
-	t2 = (s2->titletext == NULL) ? "" : s2->titletext;
+	const struct sortkey *s1 = p1, *s2 = p2;
+	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return strcasecmp(t2, t1);
+	return tiebreak(strcasecmp(s2->str, s1->str), s1, s2);
 }
 
 static int
 ititlecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
-	const char	*t1, *t2;
-	int		 rc;
-
-	t1 = (s1->titletext == NULL) ? "" : s1->titletext;
-	t2 = (s2->titletext == NULL) ? "" : s2->titletext;
+	const struct sortkey *s1 = p1, *s2 = p2;
+	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return strcasecmp(t1, t2);
+	return tiebreak(strcasecmp(s1->str, s2->str), s1, s2);
 }
 
 static int
 rtitlecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
-	const char	*t1, *t2;
-	int		 rc;
-
-	t1 = (s1->titletext == NULL) ? "" : s1->titletext;
-	t2 = (s2->titletext == NULL) ? "" : s2->titletext;
+	const struct sortkey *s1 = p1, *s2 = p2;
+	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return strcmp(t2, t1);
+	return tiebreak(strcmp(s2->str, s1->str), s1, s2);
 }
 
 static int
 titlecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
-	const char	*t1, *t2;
-	int		 rc;
-
-	t1 = (s1->titletext == NULL) ? "" : s1->titletext;
-	t2 = (s2->titletext == NULL) ? "" : s2->titletext;
+	const struct sortkey *s1 = p1, *s2 = p2;
+	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return strcmp(t1, t2);
+	return tiebreak(strcmp(s1->str, s2->str), s1, s2);
 }
 
 static int
 rdatecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
+	const struct sortkey *s1 = p1, *s2 = p2;
 	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return difftime(s1->time, s2->time);
+	return tiebreak((s1->time > s2->time) -
+	    (s1->time < s2->time), s1, s2);
 }
 
 static int
 datecmp(const void *p1, const void *p2)
 {
-	const struct article *s1 = p1, *s2 = p2;
+	const struct sortkey *s1 = p1, *s2 = p2;
 	int	     rc;
 
 	if ((rc = cmpoverride(s1, s2)) != 0)
 		return rc;
-	return difftime(s2->time, s1->time);
+	return tiebreak((s2->time > s1->time) -
+	    (s2->time < s1->time), s1, s2);
 }
 
-static void
+/*
+ * Free the contents of an article (but not the article itself).
+ */
+void
 article_free(struct article *p)
 {
 	size_t	 i;
@@ -254,43 +273,184 @@ sblg_sort_lookup(const char *s, enum asort *sort)
 }
 
 /*
- * Sort the list of articles in the manner given by "sort".
- * This will take into account per-article sort ordering.
+ * Comparison function for the sort.
  */
-void
-sblg_sort(struct article *p, size_t sz, enum asort sort)
+static int
+(*sortcmp(enum asort sort))(const void *, const void *)
 {
 
 	switch (sort) {
 	case ASORT_DATE:
-		qsort(p, sz, sizeof(struct article), datecmp);
-		break;
+		return datecmp;
 	case ASORT_RDATE:
-		qsort(p, sz, sizeof(struct article), rdatecmp);
-		break;
+		return rdatecmp;
 	case ASORT_FILENAME:
-		qsort(p, sz, sizeof(struct article), filenamecmp);
-		break;
+		return filenamecmp;
 	case ASORT_RFILENAME:
-		qsort(p, sz, sizeof(struct article), rfilenamecmp);
-		break;
+		return rfilenamecmp;
 	case ASORT_CMDLINE:
-		qsort(p, sz, sizeof(struct article), cmdlinecmp);
-		break;
+		return cmdlinecmp;
 	case ASORT_RCMDLINE:
-		qsort(p, sz, sizeof(struct article), rcmdlinecmp);
-		break;
+		return rcmdlinecmp;
 	case ASORT_TITLE:
-		qsort(p, sz, sizeof(struct article), titlecmp);
-		break;
+		return titlecmp;
 	case ASORT_RTITLE:
-		qsort(p, sz, sizeof(struct article), rtitlecmp);
-		break;
+		return rtitlecmp;
 	case ASORT_ITITLE:
-		qsort(p, sz, sizeof(struct article), ititlecmp);
-		break;
+		return ititlecmp;
 	case ASORT_RITITLE:
-		qsort(p, sz, sizeof(struct article), rititlecmp);
 		break;
 	}
+	return rititlecmp;
+}
+
+/*
+ * Fill in the sort keys of "p" for sorting by "sort".
+ */
+static struct sortkey *
+sortkeys(const struct article *p, size_t sz, enum asort sort)
+{
+	struct sortkey	*k;
+	size_t		 i;
+
+	k = xcalloc(sz + 1, sizeof(struct sortkey));
+	for (i = 0; i < sz; i++) {
+		k[i].time = p[i].time;
+		k[i].order = p[i].order;
+		k[i].sort = p[i].sort;
+		k[i].idx = i;
+		switch (sort) {
+		case ASORT_FILENAME:
+		case ASORT_RFILENAME:
+			k[i].str = p[i].src;
+			break;
+		case ASORT_TITLE:
+		case ASORT_RTITLE:
+		case ASORT_ITITLE:
+		case ASORT_RITITLE:
+			k[i].str = p[i].titletext == NULL ?
+				"" : p[i].titletext;
+			break;
+		default:
+			break;
+		}
+	}
+	return k;
+}
+
+/*
+ * Move the articles of "p" into the order of the sorted keys "k".
+ * This follows each cycle of the permutation, so each article is moved
+ * once.
+ * The keys' indices are clobbered.
+ */
+static void
+sortapply(struct article *p, size_t sz, struct sortkey *k)
+{
+	struct article	 tmp;
+	size_t		 i, j, n;
+
+	for (i = 0; i < sz; i++) {
+		if (k[i].idx == i)
+			continue;
+		tmp = p[i];
+		for (j = i; (n = k[j].idx) != i; j = n) {
+			p[j] = p[n];
+			k[j].idx = j;
+		}
+		p[j] = tmp;
+		k[j].idx = j;
+	}
+}
+
+/*
+ * Fill "idx" with the indices of "p" in the order given by "sort"
+ * without moving the articles.
+ */
+void
+article_sort_index(const struct article *p, size_t sz,
+	enum asort sort, size_t *idx)
+{
+	struct sortkey	*k;
+	size_t		 i;
+
+	k = sortkeys(p, sz, sort);
+	qsort(k, sz, sizeof(struct sortkey), sortcmp(sort));
+	for (i = 0; i < sz; i++)
+		idx[i] = k[i].idx;
+	free(k);
+}
+
+/*
+ * Sort the list of articles in the manner given by "sort".
+ * This will take into account per-article sort ordering.
+ */
+void
+sblg_sort(struct article *p, size_t sz, enum asort sort)
+{
+	struct sortkey	*k;
+
+	k = sortkeys(p, sz, sort);
+	qsort(k, sz, sizeof(struct sortkey), sortcmp(sort));
+	sortapply(p, sz, k);
+	free(k);
+}
+
+static void
+swap(struct sortkey *p, size_t i, size_t j)
+{
+	struct sortkey	 tmp;
+
+	if (i == j)
+		return;
+	tmp = p[i];
+	p[i] = p[j];
+	p[j] = tmp;
+}
+
+/*
+ * Move the first "k" articles of the sort given by "sort" to the front
+ * of the list and sort them, leaving the remainder in no particular
+ * order.
+ * This is a quickselect followed by sorting only the selected, so it's
+ * linear in "sz" (on average) instead of sorting the whole list.
+ */
+void
+sblg_sort_top(struct article *p, size_t sz, size_t k, enum asort sort)
+{
+	int		(*cmp)(const void *, const void *) = sortcmp(sort);
+	size_t		 lo = 0, hi = sz, i, st;
+	struct sortkey	*key;
+
+	if (k >= sz) {
+		sblg_sort(p, sz, sort);
+		return;
+	}
+
+	key = sortkeys(p, sz, sort);
+
+	/* Partition around a middle pivot until "k" is the boundary. */
+
+	while (k > 0 && hi - lo > 1) {
+		swap(key, lo + (hi - lo) / 2, hi - 1);
+		for (st = i = lo; i < hi - 1; i++)
+			if (cmp(&key[i], &key[hi - 1]) < 0)
+				swap(key, i, st++);
+		swap(key, st, hi - 1);
+		if (st == k || st + 1 == k)
+			break;
+		if (st > k)
+			hi = st;
+		else
+			lo = st + 1;
+	}
+
+	/*
+	 * The comparison breaks ties, so this is the head of the full
+	 * sort without qsort(3) needing to be stable.
+	 */
+
+	qsort(key, k, sizeof(struct sortkey), cmp);
+	sortapply(p, sz, key);
+	free(key);
 }
@@ -125,6 +125,7 @@ struct	atom {
 	char		*link; /* first <link> (or NULL) */
 	struct article	*sargs; /* articles */
 	size_t		 spos; /* current article */
+	size_t		 spose; /* end of articles to show */
 	size_t		 sposz; /* article length */
 	size_t		 stack; /* position in discard stack */
 	int		 entryfl; /* flags for current entry */
@@ -170,10 +171,10 @@ static void up_begin(void *, const XML_Char *, const XML_Char **);
 static void up_end(void *, const XML_Char *);
 
 static void
-atomprint(const struct atom *arg)
+atomprint(const struct atom *arg, FILE *f, size_t pos)
 {
 	char		      buf[1024];
-	struct tm	     *tm;
+	struct tm	      tm;
 	int		      idsz;
 	const struct article *src;
 
@@ -185,42 +186,42 @@ atomprint(const struct atom *arg)
 	 */
 
 	if ((arg->entryfl & ENTRY_REPL)) {
-		xmltextx(arg->f, arg->entry, "atom.xml",
+		xmltextx(f, arg->entry, "atom.xml",
 			arg->sargs, arg->sposz, arg->sposz, 
-			arg->spos, arg->spos, arg->sposz, XMLESC_NONE);
+			pos, pos, arg->sposz, XMLESC_NONE);
 		return;
 	}
 
 	/* Create an atom <entry> from the data we have. */
 
-	src = &arg->sargs[arg->spos];
-	tm = gmtime(&src->time);
-	strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ", tm);
+	src = &arg->sargs[pos];
+	gmtime_r(&src->time, &tm);
+	strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ", &tm);
 	idsz = (arg->idsz && arg->id[arg->idsz - 1] == '/') ?
 		arg->idsz - 1 : arg->idsz;
 
-	fprintf(arg->f, "\t\t<id>%.*s/%s#%s</id>\n", 
+	fprintf(f, "\t\t<id>%.*s/%s#%s</id>\n", 
 		idsz, arg->id, src->src, buf);
-	fprintf(arg->f, "\t\t<updated>%s</updated>\n", buf);
-	fprintf(arg->f, "\t\t<title>%s</title>\n", src->titletext);
-	fprintf(arg->f, "\t\t<author><name>%s</name></author>\n", 
+	fprintf(f, "\t\t<updated>%s</updated>\n", buf);
+	fprintf(f, "\t\t<title>%s</title>\n", src->titletext);
+	fprintf(f, "\t\t<author><name>%s</name></author>\n", 
 		src->authortext);
 
 	if ((arg->entryfl & ENTRY_ALT)) {
 		if (arg->entryalt != NULL) {
 			fputs("\t\t<link rel=\"alternate\" type="
-				"\"text/html\" " "href=\"", arg->f);
-			xmltextx(arg->f, arg->entryalt, "atom.xml", 
+				"\"text/html\" " "href=\"", f);
+			xmltextx(f, arg->entryalt, "atom.xml", 
 				arg->sargs, arg->sposz, arg->sposz, 
-				arg->spos, arg->spos, arg->sposz, 
+				pos, pos, arg->sposz, 
 				XMLESC_ATTR);
-			fputs("\" />\n", arg->f);
+			fputs("\" />\n", f);
 		} else if (!(arg->entryfl & ENTRY_STRIP)) {
-			fprintf(arg->f, "\t\t<link rel=\"alternate\" "
+			fprintf(f, "\t\t<link rel=\"alternate\" "
 				"type=\"text/html\" href=\"%s\" "
 				"/>\n", src->src);
 		} else {
-			fprintf(arg->f, "\t\t<link rel=\"alternate\" "
+			fprintf(f, "\t\t<link rel=\"alternate\" "
 				"type=\"text/html\" href=\"%s\" "
 				"/>\n", src->stripsrc);
 		}
@@ -234,18 +235,34 @@ atomprint(const struct atom *arg)
 	 */
 
 	fputs("\t\t<content type=\"xhtml\">\n"
-	      "\t\t\t<div xmlns=\"http://www.w3.org/1999/xhtml\">\n", arg->f);
+	      "\t\t\t<div xmlns=\"http://www.w3.org/1999/xhtml\">\n", f);
 	if ((arg->entryfl & ENTRY_CONTENT)) {
-		xmltextx(arg->f, src->article, "atom.xml", 
-			arg->sargs, arg->sposz, arg->sposz, arg->spos, 
-			arg->spos, arg->sposz, XMLESC_NONE);
+		xmltextx(f, src->article, "atom.xml", 
+			arg->sargs, arg->sposz, arg->sposz, pos, 
+			pos, arg->sposz, XMLESC_NONE);
 	} else {
-		xmltextx(arg->f, src->aside, "atom.xml",
-			arg->sargs, arg->sposz, arg->sposz, arg->spos, 
-			arg->spos, arg->sposz, XMLESC_NONE);
+		xmltextx(f, src->aside, "atom.xml",
+			arg->sargs, arg->sposz, arg->sposz, pos, 
+			pos, arg->sposz, XMLESC_NONE);
 	}
 	fputs("</div>\n"
-	      "\t\t</content>\n", arg->f);
+	      "\t\t</content>\n", f);
+}
+
+/*
+ * Print a full <entry> for jobs_print() within a data-sblg-forall
+ * entry, which is indented unless it's the first.
+ */
+static void
+entryprint(FILE *f, void *dat, size_t pos)
+{
+	const struct atom *arg = dat;
+
+	if (pos > arg->spos)
+		fputs("\t", f);
+	fputs("<entry>\n", f);
+	atomprint(arg, f, pos);
+	fputs("\t</entry>\n", f);
 }
 
 /*
@@ -253,26 +270,28 @@ atomprint(const struct atom *arg)
  * Return zero on failure, non-zero on success.
  */
 int
-atom(XML_Parser p, const char *templ, int sz, 
-	char *src[], const char *dst, enum asort asort)
+atom(XML_Parser p, const char *templ, const struct input *in,
+	int sz, char *src[], const char *dst, enum asort asort)
 {
 	char		*buf = NULL;
-	size_t		 ssz = 0, sargsz = 0;
-	int		 i, fd = -1, rc = 0;
+	size_t		 ssz = 0, sargsz = 0, lo, hi;
+	int		 fd = -1, rc = 0;
 	FILE		*f = stdout;
 	struct atom	 larg;
 	struct article	*sargs = NULL;
+	struct wlist	 wl;
 
 	memset(&larg, 0, sizeof(struct atom));
 
-	for (i = 0; i < sz; i++)
-		if (!sblg_parse(p, src[i], &sargs, &sargsz, atom_wl))
-			goto out;
-
-	sblg_sort(sargs, sargsz, asort);
+	wlist_init(&wl, atom_wl);
+	if (!corpus_load(p, in, sz, src, &wl, 
+	    asort, &sargs, &sargsz, &lo, &hi))
+		goto out;
 
-	if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
-		warn("%s", dst);
+	if (in->out != NULL)
+		f = in->out;
+	else if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
+		ctxwarn("%s", dst);
 		goto out;
 	}
 
@@ -280,6 +299,8 @@ atom(XML_Parser p, const char *templ, int sz,
 		goto out;
 
 	larg.sargs = sargs;
+	larg.spos = lo;
+	larg.spose = hi;
 	larg.sposz = sargsz;
 	larg.p = p;
 	larg.src = templ;
@@ -291,7 +312,7 @@ atom(XML_Parser p, const char *templ, int sz,
 	XML_SetUserData(p, &larg);
 
 	if (XML_Parse(p, buf, (int)ssz, 1) != XML_STATUS_OK) {
-		warnx("%s:%zu:%zu: %s", templ, 
+		ctxwarnx("%s:%zu:%zu: %s", templ, 
 			XML_GetCurrentLineNumber(p),
 			XML_GetCurrentColumnNumber(p),
 			XML_ErrorString(XML_GetErrorCode(p)));
@@ -302,8 +323,9 @@ atom(XML_Parser p, const char *templ, int sz,
 	rc = 1;
 out:
 	sblg_free(sargs, sargsz);
+	wlist_free(&wl);
 	mmap_close(fd, buf, ssz);
-	if (f != NULL && f != stdout)
+	if (f != NULL && f != stdout && f != in->out)
 		fclose(f);
 	free(larg.entry);
 	free(larg.entryalt);
@@ -332,7 +354,7 @@ up_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 {
 	struct atom	*arg = dat;
 
-	warnx("%s: no elements allowed in <updated>", arg->src);
+	ctxwarnx("%s: no elements allowed in <updated>", arg->src);
 	XML_StopParser(arg->p, 0);
 }
 
@@ -341,7 +363,7 @@ id_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 {
 	struct atom	*arg = dat;
 
-	warnx("%s: no elements allowed in <id>", arg->src);
+	ctxwarnx("%s: no elements allowed in <id>", arg->src);
 	XML_StopParser(arg->p, 0);
 }
 
@@ -361,7 +383,7 @@ tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct atom	 *arg = dat;
 	time_t		  t;
 	char		  buf[64];
-	struct tm	 *tm;
+	struct tm	  tm;
 	const XML_Char	**attp, *attsv;
 	size_t		  i;
 	enum sblgtag	  tag;
@@ -381,10 +403,10 @@ tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 		 * fields.
 		 */
 
-		t = arg->sposz <= arg->spos ?
+		t = arg->spose <= arg->spos ?
 			time(NULL) : arg->sargs[arg->spos].time;
-		tm = gmtime(&t);
-		strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ", tm);
+		gmtime_r(&t, &tm);
+		strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ", &tm);
 		fputs(buf, arg->f);
 		XML_SetDefaultHandlerExpand(arg->p, NULL);
 		XML_SetElementHandler(arg->p, up_begin, up_end);
@@ -409,7 +431,7 @@ tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 			if (strcmp(attp[0], "href") == 0)
 				break;
 		if (*attp == NULL) {
-			warnx("%s: no href", arg->src);
+			ctxwarnx("%s: no href", arg->src);
 			XML_StopParser(arg->p, 0);
 			return;
 		}
@@ -499,7 +521,7 @@ id_end(void *dat, const XML_Char *s)
 	if (arg->id == NULL) {
 		assert(arg->idsz == 0);
 		if (arg->link == NULL) {
-			warnx("%s: need at least <link> "
+			ctxwarnx("%s: need at least <link> "
 				"to create <id>", arg->src);
 			XML_StopParser(arg->p, 0);
 			return;
@@ -511,7 +533,7 @@ id_end(void *dat, const XML_Char *s)
 			cp = arg->link + 8;
 
 		if (cp == NULL) {
-			warnx("%s: need absolute <link> URL "
+			ctxwarnx("%s: need absolute <link> URL "
 				"to create <id>", arg->src);
 			XML_StopParser(arg->p, 0);
 			return;
@@ -519,8 +541,8 @@ id_end(void *dat, const XML_Char *s)
 
 		if (strchr(cp, '/') != NULL)
 			arg->id = xstrdup(arg->link);
-		else if (asprintf(&arg->id, "%s/", arg->link) == -1)
-			err(EXIT_FAILURE, "asprintf");
+		else
+			xasprintf(&arg->id, "%s/", arg->link);
 
 		arg->idsz = strlen(arg->id);
 		fputs(arg->id, arg->f);
@@ -553,7 +575,6 @@ static void
 entry_end(void *dat, const XML_Char *s)
 {
 	struct atom	*arg = dat;
-	int		 first = 1;
 
 	if (!(sblg_lookup(s) == SBLG_ELEM_ENTRY && --arg->stack == 0)) {
 		xmlstrclose(&arg->entry, &arg->entrysz, s);
@@ -567,20 +588,15 @@ entry_end(void *dat, const XML_Char *s)
 
 	/* No more articles: discard. */
 
-	if (arg->spos < arg->sposz) {
+	if (arg->spos < arg->spose) {
 		if ((arg->entryfl & ENTRY_FORALL)) {
-			while (arg->spos < arg->sposz) {
-				if (!first)
-					fputs("\t", arg->f);
-				fputs("<entry>\n", arg->f);
-				atomprint(arg);
-				fputs("\t</entry>\n", arg->f);
-				arg->spos++;
-				first = 0;
-			}
+			if (!jobs_print(arg->f, arg->spos, 
+			    arg->spose, entryprint, arg))
+				XML_StopParser(arg->p, XML_FALSE);
+			arg->spos = arg->spose;
 		} else {
 			fputs("<entry>\n", arg->f);
-			atomprint(arg);
+			atomprint(arg, arg->f, arg->spos);
 			fputs("\t</entry>\n", arg->f);
 			arg->spos++;
 		}
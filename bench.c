@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * End-to-end benchmark of the sblg binary.
+ * This generates a deterministic synthetic corpus in a scratch
+ * directory, then runs each mode over it several times, writing the
+ * timings as JSON for tracking across commits.
+ * It's run by "make bench" and isn't installed.
+ */
+
+/*
+ * Shape of the generated corpus.
+ */
+struct	corpus {
+	size_t		 arts; /* number of articles */
+	size_t		 body; /* approximate body bytes per article */
+	size_t		 tags; /* tags per article */
+	size_t		 tagvocab; /* distinct tags */
+	size_t		 navs; /* navigation elements per template */
+	size_t		 keys; /* data-sblg-set keys per article */
+	uint64_t	 seed; /* generator seed */
+	uint64_t	 state; /* generator state */
+	uint64_t	 bytes; /* total bytes of articles */
+};
+
+/*
+ * A mode to time: its name and arguments before the input files.
+ */
+struct	mode {
+	const char	*name;
+	const char	*args[8];
+};
+
+static	const struct mode modes[] = {
+	{ "blog", { "-t", "blog.xml", "-o", "blog.html", NULL } },
+	{ "compile", { "-t", "article.xml", "-c", NULL } },
+	{ "linkall", { "-t", "article.xml", "-L", NULL } },
+	{ "atom", { "-t", "atom.xml", "-o", "atom.out", "-a", NULL } },
+	{ "json", { "-o", "blog.json", "-j", NULL } },
+	{ "listtags", { "-l", NULL } },
+	{ NULL, { NULL } }
+};
+
+/*
+ * Files created in the scratch directory other than the articles and
+ * their compiled output, removed afterward.
+ */
+static	const char *const scratch[] = {
+	"blog.xml",
+	"article.xml",
+	"atom.xml",
+	"blog.html",
+	"atom.out",
+	"blog.json",
+	NULL
+};
+
+static	const char *const words[] = {
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+	"adipiscing", "elit", "sed", "do", "eiusmod", "tempor",
+	"incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua",
+	"enim", "ad", "minim", "veniam", "quis", "nostrud",
+	"exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex",
+	"ea", "commodo", "consequat",
+};
+
+#define	WORDSZ	(sizeof(words) / sizeof(words[0]))
+
+/*
+ * xorshift64*: fast, deterministic across platforms.
+ */
+static uint64_t
+rnd(struct corpus *c)
+{
+
+	c->state ^= c->state >> 12;
+	c->state ^= c->state << 25;
+	c->state ^= c->state >> 27;
+	return c->state * UINT64_C(2685821657736338717);
+}
+
+static size_t
+rndn(struct corpus *c, size_t n)
+{
+
+	return n == 0 ? 0 : rnd(c) % n;
+}
+
+static const char *
+rndword(struct corpus *c)
+{
+
+	return words[rndn(c, WORDSZ)];
+}
+
+static FILE *
+xfopen(const char *dir, const char *name)
+{
+	char	 path[PATH_MAX];
+	FILE	*f;
+
+	if ((size_t)snprintf(path, sizeof(path),
+	    "%s/%s", dir, name) >= sizeof(path))
+		errx(EXIT_FAILURE, "%s/%s: path too long", dir, name);
+	if ((f = fopen(path, "w")) == NULL)
+		err(EXIT_FAILURE, "%s", path);
+	return f;
+}
+
+static void
+xfclose(FILE *f, const char *name)
+{
+
+	if (fflush(f) == EOF || ferror(f))
+		err(EXIT_FAILURE, "%s", name);
+	fclose(f);
+}
+
+/*
+ * Write the navigation elements of a template.
+ */
+static void
+gen_navs(FILE *f, const struct corpus *c)
+{
+	size_t	 i;
+
+	for (i = 0; i < c->navs; i++)
+		fprintf(f, "<nav data-sblg-nav=\"1\" "
+			"data-sblg-navsz=\"%zu\">"
+			"<a href=\"${sblg-base}.html\">${sblg-title}</a> "
+			"<time>${sblg-date}</time> "
+			"${sblg-tags}</nav>\n", (i + 1) * 10);
+}
+
+static void
+gen_templates(const char *dir, const struct corpus *c)
+{
+	FILE	*f;
+
+	f = xfopen(dir, "blog.xml");
+	fputs("<!DOCTYPE html>\n<html>\n<head><title>Bench</title>"
+	    "</head>\n<body>\n", f);
+	gen_navs(f, c);
+	fputs("<article data-sblg-article=\"1\" />\n"
+	    "<article data-sblg-article=\"1\" />\n"
+	    "<article data-sblg-article=\"1\" />\n"
+	    "</body>\n</html>\n", f);
+	xfclose(f, "blog.xml");
+
+	f = xfopen(dir, "article.xml");
+	fputs("<!DOCTYPE html>\n<html>\n<head><title>${sblg-title}"
+	    "</title></head>\n<body>\n", f);
+	gen_navs(f, c);
+	fputs("<article data-sblg-article=\"1\" />\n"
+	    "<footer>${sblg-author} ${sblg-get|key0}</footer>\n"
+	    "</body>\n</html>\n", f);
+	xfclose(f, "article.xml");
+
+	f = xfopen(dir, "atom.xml");
+	fputs("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+	    "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n"
+	    "<title>Bench</title>\n"
+	    "<link href=\"https://example.com/\" />\n"
+	    "<id />\n<updated />\n"
+	    "<entry data-sblg-forall=\"1\" data-sblg-entry=\"1\" />\n"
+	    "</feed>\n", f);
+	xfclose(f, "atom.xml");
+}
+
+/*
+ * Write article "n" with a body of about c->body bytes of paragraphs
+ * with some inline markup.
+ */
+static void
+gen_article(const char *dir, struct corpus *c, size_t n)
+{
+	char	 name[64];
+	FILE	*f;
+	size_t	 i, par;
+	long	 off;
+	time_t	 t;
+	struct tm tm;
+
+	snprintf(name, sizeof(name), "a%zu.xml", n);
+	f = xfopen(dir, name);
+
+	fputs("<!DOCTYPE html>\n<html>\n<body>\n"
+	    "<article data-sblg-article=\"1\"", f);
+	if (c->tags > 0) {
+		fputs(" data-sblg-tags=\"", f);
+		for (i = 0; i < c->tags; i++)
+			fprintf(f, "%stag%zu", i ? " " : "",
+				rndn(c, c->tagvocab));
+		fputc('"', f);
+	}
+	for (i = 0; i < c->keys; i++)
+		fprintf(f, " data-sblg-set-key%zu=\"%s %s\"",
+			i, rndword(c), rndword(c));
+	fputs(">\n", f);
+
+	t = (time_t)946684800 + (time_t)rndn(c, 20 * 365) * 86400;
+	gmtime_r(&t, &tm);
+	fprintf(f, "<header>\n<h1>%s %s %zu</h1>\n"
+	    "<address>%s %s</address>\n"
+	    "<time datetime=\"%04d-%02d-%02d\">%04d-%02d-%02d</time>\n"
+	    "</header>\n<aside>%s <b>%s</b> %s.</aside>\n",
+	    rndword(c), rndword(c), n, rndword(c), rndword(c),
+	    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+	    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+	    rndword(c), rndword(c), rndword(c));
+
+	if ((off = ftell(f)) == -1)
+		err(EXIT_FAILURE, "%s", name);
+	for (par = 0; (size_t)(ftell(f) - off) < c->body; par++) {
+		fputs("<p>", f);
+		for (i = 0; i < 60; i++) {
+			switch (rndn(c, 16)) {
+			case 0:
+				fprintf(f, "<b>%s</b> ", rndword(c));
+				break;
+			case 1:
+				fprintf(f, "<a href=\"a%zu.html\">%s</a> ",
+					rndn(c, c->arts), rndword(c));
+				break;
+			case 2:
+				fprintf(f, "%s &amp; ", rndword(c));
+				break;
+			default:
+				fprintf(f, "%s ", rndword(c));
+				break;
+			}
+		}
+		fputs("</p>\n", f);
+		if (par == 0 && rndn(c, 4) == 0)
+			fprintf(f, "<img src=\"a%zu.jpg\" alt=\"\" />\n", n);
+	}
+
+	fputs("</article>\n</body>\n</html>\n", f);
+	if ((off = ftell(f)) == -1)
+		err(EXIT_FAILURE, "%s", name);
+	c->bytes += off;
+	xfclose(f, name);
+}
+
+static void
+gen_corpus(const char *dir, struct corpus *c)
+{
+	size_t	 i;
+
+	c->state = c->seed == 0 ? 1 : c->seed;
+	c->bytes = 0;
+	gen_templates(dir, c);
+	for (i = 0; i < c->arts; i++)
+		gen_article(dir, c, i);
+}
+
+static void
+rm_corpus(const char *dir, const struct corpus *c)
+{
+	char	 path[PATH_MAX];
+	size_t	 i;
+
+	for (i = 0; i < c->arts; i++) {
+		snprintf(path, sizeof(path), "%s/a%zu.xml", dir, i);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/a%zu.html", dir, i);
+		unlink(path);
+	}
+	for (i = 0; scratch[i] != NULL; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, scratch[i]);
+		unlink(path);
+	}
+	if (rmdir(dir) == -1)
+		warn("%s", dir);
+}
+
+static double
+tv2d(const struct timeval *tv)
+{
+
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/*
+ * Run "argv" in "dir" with standard output discarded.
+ * Fill in the wall, user, and system seconds.
+ */
+static void
+run(const char *dir, char *argv[], double *wall, double *usr, double *sys)
+{
+	struct timespec	 t0, t1;
+	struct rusage	 r0, r1;
+	pid_t		 pid;
+	int		 st, fd;
+
+	getrusage(RUSAGE_CHILDREN, &r0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if ((pid = fork()) == -1)
+		err(EXIT_FAILURE, "fork");
+	if (pid == 0) {
+		if (chdir(dir) == -1)
+			err(EXIT_FAILURE, "%s", dir);
+		if ((fd = open("/dev/null", O_WRONLY)) == -1)
+			err(EXIT_FAILURE, "/dev/null");
+		if (dup2(fd, STDOUT_FILENO) == -1)
+			err(EXIT_FAILURE, "dup2");
+		execv(argv[0], argv);
+		err(EXIT_FAILURE, "%s", argv[0]);
+	}
+	if (waitpid(pid, &st, 0) == -1)
+		err(EXIT_FAILURE, "waitpid");
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	getrusage(RUSAGE_CHILDREN, &r1);
+
+	if (!WIFEXITED(st) || WEXITSTATUS(st) != 0)
+		errx(EXIT_FAILURE, "%s %s: failed", argv[0], argv[1]);
+
+	*wall = (t1.tv_sec - t0.tv_sec) +
+		(t1.tv_nsec - t0.tv_nsec) / 1e9;
+	*usr = tv2d(&r1.ru_utime) - tv2d(&r0.ru_utime);
+	*sys = tv2d(&r1.ru_stime) - tv2d(&r0.ru_stime);
+}
+
+static int
+dblcmp(const void *a, const void *b)
+{
+	double	 x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Time mode "m" with "warm" unrecorded and "reps" recorded runs,
+ * writing its JSON object to "out".
+ */
+static void
+bench(FILE *out, const char *dir, const char *sblg,
+    const struct corpus *c, const struct mode *m,
+    size_t warm, size_t reps)
+{
+	char		**argv, **names;
+	double		 *wall, *sorted, usr = 0.0, sys = 0.0, u, s, sum = 0.0,
+			  median;
+	size_t		  i, argc, nargs;
+
+	for (nargs = 0; m->args[nargs] != NULL; nargs++)
+		continue;
+
+	if ((argv = calloc(nargs + c->arts + 2, sizeof(char *))) == NULL ||
+	    (names = calloc(c->arts, sizeof(char *))) == NULL ||
+	    (wall = calloc(reps, sizeof(double))) == NULL ||
+	    (sorted = calloc(reps, sizeof(double))) == NULL)
+		err(EXIT_FAILURE, NULL);
+
+	argc = 0;
+	argv[argc++] = (char *)sblg;
+	for (i = 0; i < nargs; i++)
+		argv[argc++] = (char *)m->args[i];
+	for (i = 0; i < c->arts; i++) {
+		if (asprintf(&names[i], "a%zu.xml", i) == -1)
+			err(EXIT_FAILURE, NULL);
+		argv[argc++] = names[i];
+	}
+	argv[argc] = NULL;
+
+	for (i = 0; i < warm; i++)
+		run(dir, argv, &wall[0], &u, &s);
+	for (i = 0; i < reps; i++) {
+		run(dir, argv, &wall[i], &u, &s);
+		usr += u;
+		sys += s;
+		sum += wall[i];
+	}
+
+	memcpy(sorted, wall, reps * sizeof(double));
+	qsort(sorted, reps, sizeof(double), dblcmp);
+	median = reps % 2 ? sorted[reps / 2] :
+		(sorted[reps / 2 - 1] + sorted[reps / 2]) / 2.0;
+
+	fprintf(out, "    {\"mode\": \"%s\",\n"
+	    "     \"args\": \"", m->name);
+	for (i = 0; i < nargs; i++)
+		fprintf(out, "%s%s", i ? " " : "", m->args[i]);
+	fputs("\",\n     \"runs\": [", out);
+	for (i = 0; i < reps; i++)
+		fprintf(out, "%s%.6f", i ? ", " : "", wall[i]);
+	fprintf(out, "],\n"
+	    "     \"min\": %.6f, \"median\": %.6f, "
+	    "\"mean\": %.6f, \"max\": %.6f,\n"
+	    "     \"user\": %.6f, \"sys\": %.6f,\n"
+	    "     \"bytes_per_sec\": %.0f}",
+	    sorted[0], median, sum / reps, sorted[reps - 1],
+	    usr / reps, sys / reps,
+	    median > 0.0 ? (double)c->bytes / median : 0.0);
+
+	for (i = 0; i < c->arts; i++)
+		free(names[i]);
+	free(names);
+	free(argv);
+	free(wall);
+	free(sorted);
+}
+
+static size_t
+numarg(const char *arg, int flag, long long min)
+{
+	const char	*er;
+	long long	 v;
+
+	v = strtonum(arg, min, INT_MAX, &er);
+	if (er != NULL)
+		errx(EXIT_FAILURE, "-%c %s: %s", flag, arg, er);
+	return (size_t)v;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct corpus	 c;
+	const char	*sblg, *only = NULL, *outf = NULL;
+	char		*dir = NULL, tmpl[] = "/tmp/sblg-bench.XXXXXX",
+			 path[PATH_MAX];
+	FILE		*out = stdout;
+	size_t		 i, warm = 1, reps = 5;
+	int		 ch, keep = 0;
+
+	memset(&c, 0, sizeof(struct corpus));
+	c.arts = 500;
+	c.body = 4096;
+	c.tags = 3;
+	c.tagvocab = 32;
+	c.navs = 1;
+	c.keys = 2;
+	c.seed = 1;
+
+	while ((ch = getopt(argc, argv, "b:d:k:m:n:N:o:r:s:t:T:w:")) != -1)
+		switch (ch) {
+		case 'b':
+			c.body = numarg(optarg, ch, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			keep = 1;
+			break;
+		case 'k':
+			c.keys = numarg(optarg, ch, 0);
+			break;
+		case 'm':
+			only = optarg;
+			break;
+		case 'n':
+			c.arts = numarg(optarg, ch, 1);
+			break;
+		case 'N':
+			c.navs = numarg(optarg, ch, 0);
+			break;
+		case 'o':
+			outf = optarg;
+			break;
+		case 'r':
+			reps = numarg(optarg, ch, 1);
+			break;
+		case 's':
+			c.seed = numarg(optarg, ch, 0);
+			break;
+		case 't':
+			c.tags = numarg(optarg, ch, 0);
+			break;
+		case 'T':
+			c.tagvocab = numarg(optarg, ch, 1);
+			break;
+		case 'w':
+			warm = numarg(optarg, ch, 0);
+			break;
+		default:
+			goto usage;
+		}
+
+	argc -= optind;
+	argv += optind;
+	if (argc > 1)
+		goto usage;
+
+	/* The binary is run from the scratch directory. */
+
+	if (realpath(argc ? argv[0] : "sblg", path) == NULL)
+		err(EXIT_FAILURE, "%s", argc ? argv[0] : "sblg");
+	if ((sblg = strdup(path)) == NULL)
+		err(EXIT_FAILURE, NULL);
+
+	if (only != NULL) {
+		for (i = 0; modes[i].name != NULL; i++)
+			if (strcmp(modes[i].name, only) == 0)
+				break;
+		if (modes[i].name == NULL)
+			errx(EXIT_FAILURE, "-m %s: unknown mode", only);
+	}
+
+	if (dir == NULL) {
+		if ((dir = mkdtemp(tmpl)) == NULL)
+			err(EXIT_FAILURE, "%s", tmpl);
+	} else if (mkdir(dir, 0755) == -1)
+		err(EXIT_FAILURE, "%s", dir);
+
+	if (outf != NULL && (out = fopen(outf, "w")) == NULL)
+		err(EXIT_FAILURE, "%s", outf);
+
+	gen_corpus(dir, &c);
+
+	fprintf(out, "{\"sblg\": \"%s\",\n"
+	    " \"corpus\": {\"articles\": %zu, \"body\": %zu, "
+	    "\"tags\": %zu, \"tagvocab\": %zu, \"navs\": %zu, "
+	    "\"keys\": %zu, \"seed\": %" PRIu64 ", \"bytes\": %" PRIu64 "},\n"
+	    " \"warmup\": %zu, \"reps\": %zu,\n"
+	    " \"modes\": [\n", sblg, c.arts, c.body, c.tags,
+	    c.tagvocab, c.navs, c.keys, c.seed, c.bytes, warm, reps);
+
+	for (ch = 0, i = 0; modes[i].name != NULL; i++) {
+		if (only != NULL && strcmp(modes[i].name, only))
+			continue;
+		if (ch++)
+			fputs(",\n", out);
+		bench(out, dir, sblg, &c, &modes[i], warm, reps);
+		fflush(out);
+	}
+	fputs("\n ]\n}\n", out);
+
+	if (!keep)
+		rm_corpus(dir, &c);
+	free((char *)sblg);
+	if (out != stdout)
+		xfclose(out, outf);
+	return EXIT_SUCCESS;
+usage:
+	fprintf(stderr, "usage: %s [-b body] [-d dir] [-k keys] "
+		"[-m mode] [-N navs] [-n articles] [-o file]\n"
+		"       [-r reps] [-s seed] [-T tagvocab] [-t tags] "
+		"[-w warmup] [sblg]\n", getprogname());
+	return EXIT_FAILURE;
+}
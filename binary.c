@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+#include "sblgbin.h"
+
+/*
+ * Article strings in the order of enum sblgbin_str.
+ */
+static	const size_t binstrs[SBLGBIN_STR__MAX] = {
+	offsetof(struct article, src), /* SBLGBIN_SRC */
+	offsetof(struct article, base), /* SBLGBIN_BASE */
+	offsetof(struct article, stripsrc), /* SBLGBIN_STRIPSRC */
+	offsetof(struct article, stripbase), /* SBLGBIN_STRIPBASE */
+	offsetof(struct article, striplangbase), /* SBLGBIN_STRIPLANGBASE */
+	offsetof(struct article, real), /* SBLGBIN_REAL */
+	offsetof(struct article, title), /* SBLGBIN_TITLE */
+	offsetof(struct article, titletext), /* SBLGBIN_TITLETEXT */
+	offsetof(struct article, aside), /* SBLGBIN_ASIDE */
+	offsetof(struct article, asidetext), /* SBLGBIN_ASIDETEXT */
+	offsetof(struct article, author), /* SBLGBIN_AUTHOR */
+	offsetof(struct article, authortext), /* SBLGBIN_AUTHORTEXT */
+	offsetof(struct article, article), /* SBLGBIN_ARTICLE */
+	offsetof(struct article, img), /* SBLGBIN_IMG */
+};
+
+#define	BINSTR(_a, _i) \
+	(*(char **)((char *)(_a) + binstrs[(_i)]))
+
+static void
+bin_u32(FILE *f, uint32_t v)
+{
+
+	fputc(v & 0xff, f);
+	fputc((v >> 8) & 0xff, f);
+	fputc((v >> 16) & 0xff, f);
+	fputc((v >> 24) & 0xff, f);
+}
+
+static void
+bin_u64(FILE *f, uint64_t v)
+{
+
+	bin_u32(f, v & 0xffffffff);
+	bin_u32(f, v >> 32);
+}
+
+/*
+ * Write the reference to "cp" and advance the pool offset "off".
+ */
+static void
+bin_ref(FILE *f, const char *cp, uint64_t *off)
+{
+	size_t	 sz;
+
+	if (cp == NULL) {
+		bin_u32(f, SBLGBIN_NULL);
+		bin_u32(f, 0);
+		return;
+	}
+	sz = strlen(cp);
+	bin_u32(f, *off);
+	bin_u32(f, sz);
+	*off += sz + 1;
+}
+
+static size_t
+bin_size(const char *cp)
+{
+
+	return cp == NULL ? 0 : strlen(cp) + 1;
+}
+
+/*
+ * Write the sorted articles in "src" as the binary format described in
+ * sblgbin.h into "dst", or stdout if "dst" is "-".
+ * Returns zero on failure, non-zero on success.
+ */
+int
+binary(XML_Parser p, const struct input *in, int sz, char *src[],
+	const char *dst, enum asort asort)
+{
+	FILE		*f = stdout;
+	size_t		 sargsz = 0, lo, hi, i, j;
+	uint64_t	 nlists = 0, poolsz = 0, lists, pool, off, list;
+	int		 rc = 0;
+	struct article	*sargs = NULL, *a;
+
+	if (!corpus_load(p, in, sz, src, NULL,
+	    asort, &sargs, &sargsz, &lo, &hi))
+		goto out;
+
+	/* Size the lists and pool to lay out the sections. */
+
+	for (i = lo; i < hi; i++) {
+		a = &sargs[i];
+		for (j = 0; j < SBLGBIN_STR__MAX; j++)
+			poolsz += bin_size(BINSTR(a, j));
+		for (j = 0; j < a->tagmapsz; j++)
+			poolsz += bin_size(a->tagmap[j]);
+		for (j = 0; j < a->setmapsz; j++)
+			poolsz += bin_size(a->setmap[j]);
+		nlists += a->tagmapsz + a->setmapsz;
+	}
+
+	if (poolsz >= SBLGBIN_NULL || nlists >= UINT32_MAX) {
+		ctxwarnx("%s: too large for binary output", dst);
+		goto out;
+	}
+
+	lists = SBLGBIN_HEADSZ + (uint64_t)(hi - lo) * SBLGBIN_RECSZ;
+	pool = lists + nlists * 8;
+
+	if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
+		ctxwarn("%s", dst);
+		goto out;
+	}
+
+	/* Header. */
+
+	fwrite(SBLGBIN_MAGIC, 1, sizeof(SBLGBIN_MAGIC), f);
+	bin_u32(f, SBLGBIN_VERSION);
+	bin_u32(f, SBLGBIN_RECSZ);
+	bin_u32(f, SBLGBIN_STR__MAX);
+	bin_u32(f, hi - lo);
+	bin_u64(f, SBLGBIN_HEADSZ);
+	bin_u64(f, lists);
+	bin_u32(f, nlists);
+	bin_u32(f, 0);
+	bin_u64(f, pool);
+	bin_u64(f, poolsz);
+
+	/*
+	 * Article records.
+	 * Their strings are first in the pool, followed by those of the
+	 * lists in order.
+	 */
+
+	for (off = 0, list = 0, i = lo; i < hi; i++) {
+		a = &sargs[i];
+		for (j = 0; j < SBLGBIN_STR__MAX; j++)
+			bin_ref(f, BINSTR(a, j), &off);
+		bin_u64(f, (uint64_t)(int64_t)a->time);
+		bin_u32(f, a->isdatetime ? SBLGBIN_DATETIME : 0);
+		bin_u32(f, a->sort);
+		bin_u32(f, a->order);
+		bin_u32(f, list);
+		bin_u32(f, a->tagmapsz);
+		bin_u32(f, list + a->tagmapsz);
+		bin_u32(f, a->setmapsz / 2);
+		bin_u32(f, 0);
+		list += a->tagmapsz + a->setmapsz;
+	}
+
+	for (i = lo; i < hi; i++) {
+		a = &sargs[i];
+		for (j = 0; j < a->tagmapsz; j++)
+			bin_ref(f, a->tagmap[j], &off);
+		for (j = 0; j < a->setmapsz; j++)
+			bin_ref(f, a->setmap[j], &off);
+	}
+
+	/* String pool in the same order. */
+
+	for (i = lo; i < hi; i++)
+		for (j = 0; j < SBLGBIN_STR__MAX; j++)
+			if (BINSTR(&sargs[i], j) != NULL)
+				fwrite(BINSTR(&sargs[i], j), 1,
+					bin_size(BINSTR(&sargs[i], j)), f);
+
+	for (i = lo; i < hi; i++) {
+		a = &sargs[i];
+		for (j = 0; j < a->tagmapsz; j++)
+			fwrite(a->tagmap[j], 1, bin_size(a->tagmap[j]), f);
+		for (j = 0; j < a->setmapsz; j++)
+			fwrite(a->setmap[j], 1, bin_size(a->setmap[j]), f);
+	}
+
+	if (fflush(f) == EOF || ferror(f)) {
+		ctxwarn("%s", dst);
+		goto out;
+	}
+
+	rc = 1;
+out:
+	if (f != NULL && f != stdout)
+		fclose(f);
+	sblg_free(sargs, sargsz);
+	return rc;
+}
@@ -34,20 +34,112 @@ enum	textmode {
 	TEXT_NONE,
 };
 
+/*
+ * Operations recorded from the template, replayed for each article.
+ */
+enum	toptype {
+	TOP_TEXT, /* text with symbols */
+	TOP_OPEN, /* element with symbols in attributes */
+	TOP_OPENRAW, /* element (data-sblg-ign-once) */
+	TOP_CLOSE, /* close of element */
+	TOP_ARTICLE, /* article content */
+};
+
+struct	top {
+	enum toptype	 type;
+	char		*name; /* element name or text */
+	char		**atts; /* NULL-terminated attributes or NULL */
+};
+
+/*
+ * A template parsed once for any number of articles.
+ */
+struct	tmpl {
+	struct top	*ops;
+	size_t		 opsz;
+};
+
 struct	pargs {
 	const char	*src; /* template file */
-	const char	*dst; /* output file (or empty) */
-	FILE		*f; /* output stream */
 	XML_Parser	 p; /* active parser */
 	size_t		 stack; /* temporary: tag stack size */
-	struct article	*article; /* standalone article */
+	struct tmpl	*tmpl; /* template being recorded */
 	char		*buf; /* buffer for text */
 	size_t		 bufsz; /* buffer size */
-	size_t		 bufmax; /* buffer maximum size */
 	enum textmode	 textmode; /* mode to accept text */
 	char		*stacktag; /* tag starting article or NULL */
 };
 
+/*
+ * Batch of articles compiled in parallel by compile_batch().
+ */
+struct	batch {
+	const struct tmpl *tmpl;
+	XML_Parser	 *ps; /* parser per worker (or NULL) */
+	char		**src; /* input files */
+	int		 *failed; /* whether each input failed */
+};
+
+static struct top *
+top_add(struct tmpl *t, enum toptype type, const char *name)
+{
+	struct top	*op;
+
+	t->ops = xreallocarray(t->ops, t->opsz + 1, sizeof(struct top));
+	op = &t->ops[t->opsz++];
+	memset(op, 0, sizeof(struct top));
+	op->type = type;
+	if (name != NULL)
+		op->name = xstrdup(name);
+	return op;
+}
+
+/*
+ * Record any pending text.
+ */
+static void
+top_text(struct pargs *arg)
+{
+
+	if (arg->buf != NULL && arg->buf[0] != '\0')
+		top_add(arg->tmpl, TOP_TEXT, NULL)->name = arg->buf;
+	else
+		free(arg->buf);
+	arg->buf = NULL;
+	arg->bufsz = 0;
+}
+
+static void
+top_elem(struct pargs *arg, enum toptype type,
+	const XML_Char *s, const XML_Char **atts)
+{
+	struct top	*op;
+	size_t		 i, n;
+
+	op = top_add(arg->tmpl, type, s);
+	for (n = 0; atts[n] != NULL; n++)
+		continue;
+	op->atts = xcalloc(n + 1, sizeof(char *));
+	for (i = 0; i < n; i++)
+		op->atts[i] = xstrdup(atts[i]);
+}
+
+static void
+tmpl_free(struct tmpl *t)
+{
+	size_t	 i, j;
+
+	for (i = 0; i < t->opsz; i++) {
+		free(t->ops[i].name);
+		if (t->ops[i].atts == NULL)
+			continue;
+		for (j = 0; t->ops[i].atts[j] != NULL; j++)
+			free(t->ops[i].atts[j]);
+		free(t->ops[i].atts);
+	}
+	free(t->ops);
+}
+
 static void
 text(void *dat, const XML_Char *s, int len)
 {
@@ -81,12 +173,8 @@ template_end(void *dat, const XML_Char *s)
 {
 	struct pargs	*arg = dat;
 
-	xmltextx(arg->f, arg->buf, arg->dst, 
-		arg->article, 1, 1, 0, 0, 1, XMLESC_NONE);
-	free(arg->buf);
-	arg->buf = NULL;
-	arg->bufsz = 0;
-	xmlclose(arg->f, s);
+	top_text(arg);
+	top_add(arg->tmpl, TOP_CLOSE, s);
 }
 
 /*
@@ -134,12 +222,7 @@ template_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 
 	assert(arg->stack == 0);
 
-	xmltextx(arg->f, arg->buf, arg->dst, 
-		arg->article, 1, 1, 0, 0, 1, XMLESC_NONE);
-
-	free(arg->buf);
-	arg->buf = NULL;
-	arg->bufsz = 0;
+	top_text(arg);
 
 	/* Look for the true-valued data-sblg-article.  */
 
@@ -151,8 +234,7 @@ template_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 		}
 
 	if (!start_article) {
-		xmlopensx(arg->f, s, atts, 
-			arg->dst, arg->article, 1, 0);
+		top_elem(arg, TOP_OPEN, s, atts);
 		return;
 	}
 
@@ -164,7 +246,7 @@ template_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	for (attp = atts; *attp != NULL; attp += 2)
 		if (sblg_lookup(*attp) == SBLG_ATTR_IGN_ONCE &&
 		    xmlbool(attp[1])) {
-			xmlopens(arg->f, s, atts);
+			top_elem(arg, TOP_OPENRAW, s, atts);
 			return;
 		}
 
@@ -180,78 +262,31 @@ template_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	arg->stack++;
 	arg->textmode = TEXT_NONE;
 	XML_SetElementHandler(arg->p, article_begin, article_end);
-	xmltextx(arg->f, arg->article->article, arg->dst,
-		arg->article, 1, 1, 0, 0, 1, XMLESC_NONE);
+	top_add(arg->tmpl, TOP_ARTICLE, NULL);
 }
 
 /*
- * Merge a single input XML file into a template XML files to produce
- * output.
- * (This can happen multiple times if we're spitting into stdout.)
- * Return zero on fatal error, non-zero on success.
+ * Parse the template "templ" into "t".
+ * Return zero on failure, non-zero on success.
  */
-int
-compile(XML_Parser p, const char *templ, 
-	const char *src, const char *dst)
+static int
+tmpl_parse(XML_Parser p, const char *templ, struct tmpl *t)
 {
-	char		*out = NULL, *cp, *buf = NULL;
-	size_t		 sz = 0, sargsz = 0;
+	char		*buf = NULL;
+	size_t		 sz = 0;
 	int		 fd = -1, rc = 0;
-	FILE		*f = stdout;
 	struct pargs	 arg;
-	struct article	*sargs = NULL;
 
 	memset(&arg, 0, sizeof(struct pargs));
-
-	if (!sblg_parse(p, src, &sargs, &sargsz, NULL))
-		goto out;
-
-	if (sargsz == 0) {
-		warnx("%s: contains no article", src);
-		goto out;
-	} else if (sargsz > 1)
-		warnx("%s: contains multiple "
-			"articles (using the first)", src);
-
-	arg.article = &sargs[0];
-
-	/*
-	 * If we have no output file name, then name it the same as the
-	 * input but with ".html" at the end.
-	 * However, if we have ".xml", then replace that with ".html".
-	 */
-
-	if (dst == NULL) {
-		sz = strlen(src);
-		if ((cp = strrchr(src, '.')) == NULL ||
-		    strcasecmp(cp + 1, "xml")) {
-			/* Append .html to input name. */
-			out = xmalloc(sz + 6);
-			strlcpy(out, src, sz + 6);
-			strlcat(out, ".html", sz + 6);
-		} else {
-			/* Replace .xml with .html. */
-			out = xmalloc(sz + 2);
-			strlcpy(out, src, sz - 2);
-			strlcat(out, "html", sz + 2);
-		} 
-	} else
-		out = xstrdup(dst);
-
-	if (strcmp(out, "-") && (f = fopen(out, "w")) == NULL) {
-		warn("%s", out);
-		goto out;
-	} 
+	memset(t, 0, sizeof(struct tmpl));
 
 	if (!mmap_open(templ, &fd, &buf, &sz))
 		goto out;
 
-	arg.f = f;
-	arg.src = src;
-	arg.dst = strcmp(out, "-") ? out : NULL;
+	arg.src = templ;
 	arg.p = p;
+	arg.tmpl = t;
 	arg.textmode = TEXT_TMPL;
-	arg.stacktag = NULL;
 
 	XML_ParserReset(p, NULL);
 	XML_SetElementHandler(p, template_begin, template_end);
@@ -261,25 +296,218 @@ compile(XML_Parser p, const char *templ,
 	XML_UseForeignDTD(p, XML_TRUE);
 
 	if (XML_Parse(p, buf, (int)sz, 1) != XML_STATUS_OK) {
-		warnx("%s:%zu:%zu: %s", templ, 
+		ctxwarnx("%s:%zu:%zu: %s", templ, 
 			XML_GetCurrentLineNumber(p),
 			XML_GetCurrentColumnNumber(p),
 			XML_ErrorString(XML_GetErrorCode(p)));
 		goto out;
 	} 
 
-	xmltextx(arg.f, arg.buf, arg.dst, 
-		arg.article, 1, 1, 0, 0, 1, XMLESC_NONE);
-	fputc('\n', f);
+	top_text(&arg);
 	rc = 1;
 out:
 	mmap_close(fd, buf, sz);
-	if (f != NULL && f != stdin)
-		fclose(f);
-	sblg_free(sargs, sargsz);
-	free(out);
 	free(arg.buf);
 	free(arg.stacktag);
 	return rc;
 }
 
+/*
+ * Write the template "t" filled in by article "art" into "f".
+ * The "dst" is the output file name or NULL for standard output.
+ */
+static void
+tmpl_write(FILE *f, const struct tmpl *t,
+	const struct article *art, const char *dst)
+{
+	size_t		 i;
+	const struct top *op;
+
+	for (i = 0; i < t->opsz; i++) {
+		op = &t->ops[i];
+		switch (op->type) {
+		case TOP_TEXT:
+			xmltextx(f, op->name, dst, 
+				art, 1, 1, 0, 0, 1, XMLESC_NONE);
+			break;
+		case TOP_OPEN:
+			xmlopensx(f, op->name, 
+				(const XML_Char **)op->atts, dst, art, 1, 0);
+			break;
+		case TOP_OPENRAW:
+			xmlopens(f, op->name, (const XML_Char **)op->atts);
+			break;
+		case TOP_CLOSE:
+			xmlclose(f, op->name);
+			break;
+		case TOP_ARTICLE:
+			xmltextx(f, art->article, dst,
+				art, 1, 1, 0, 0, 1, XMLESC_NONE);
+			break;
+		}
+	}
+	fputc('\n', f);
+}
+
+/*
+ * Merge a single input XML file into a parsed template to produce
+ * output.
+ * If "of" is not NULL, write into it as if to standard output.
+ * Return zero on fatal error, non-zero on success.
+ */
+static int
+compile_one(XML_Parser p, const struct tmpl *t,
+	const char *src, const char *dst, FILE *of)
+{
+	char		*out = NULL;
+	size_t		 sargsz = 0;
+	int		 rc = 0;
+	FILE		*f = stdout;
+	struct article	*sargs = NULL;
+
+	if (!grok(p, src, &sargs, &sargsz, NULL, 0))
+		goto out;
+
+	if (sargsz == 0) {
+		ctxwarnx("%s: contains no article", src);
+		goto out;
+	} else if (sargsz > 1)
+		ctxwarnx("%s: contains multiple "
+			"articles (using the first)", src);
+
+	if (of != NULL) {
+		tmpl_write(of, t, &sargs[0], NULL);
+		rc = 1;
+		goto out;
+	}
+
+	/*
+	 * If we have no output file name, then name it the same as the
+	 * input as html_name() does.
+	 * Standard input has no name, so it's written to standard output.
+	 */
+
+	if (dst != NULL)
+		out = xstrdup(dst);
+	else if (strcmp(src, "-") == 0)
+		out = xstrdup("-");
+	else
+		out = html_name(src);
+
+	if (strcmp(out, "-") && (f = fopen(out, "w")) == NULL) {
+		ctxwarn("%s", out);
+		goto out;
+	} 
+
+	tmpl_write(f, t, &sargs[0], strcmp(out, "-") ? out : NULL);
+	rc = 1;
+out:
+	if (f != NULL && f != stdout && fclose(f) == EOF) {
+		ctxwarn("%s", out);
+		rc = 0;
+	}
+	sblg_free(sargs, sargsz);
+	free(out);
+	return rc;
+}
+
+/*
+ * Merge a single input XML file into a template XML files to produce
+ * output.
+ * (This can happen multiple times if we're spitting into stdout.)
+ * Return zero on fatal error, non-zero on success.
+ */
+int
+compile(XML_Parser p, const char *templ, 
+	const char *src, const char *dst)
+{
+	struct tmpl	 t;
+	int		 rc = 0;
+
+	if (tmpl_parse(p, templ, &t))
+		rc = compile_one(p, &t, src, dst, NULL);
+	tmpl_free(&t);
+	return rc;
+}
+
+/*
+ * Like compile(), but writing to "f" as if to standard output.
+ * Return zero on fatal error, non-zero on success.
+ */
+int
+compile_file(XML_Parser p, const char *templ, const char *src, FILE *f)
+{
+	struct tmpl	 t;
+	int		 rc = 0;
+
+	if (tmpl_parse(p, templ, &t))
+		rc = compile_one(p, &t, src, NULL, f);
+	tmpl_free(&t);
+	return rc;
+}
+
+static int
+batch_job(void *dat, size_t worker, size_t item)
+{
+	struct batch	*b = dat;
+
+	if (b->ps[worker] == NULL &&
+	    (b->ps[worker] = XML_ParserCreate(NULL)) == NULL) {
+		ctxwarnx("XML_ParserCreate");
+		b->failed[item] = 1;
+		return 1;
+	}
+
+	/* Don't stop the batch on failure: just record it. */
+
+	if (!compile_one(b->ps[worker], b->tmpl, b->src[item], NULL, NULL))
+		b->failed[item] = 1;
+	return 1;
+}
+
+/*
+ * Like compile() for each of the "sz" files in "src", parsing the
+ * template only once and compiling articles in parallel, each into
+ * its default output file.
+ * All articles are attempted even if some fail, with failures being
+ * listed when all are done.
+ * Return zero if any failed, non-zero on success.
+ */
+int
+compile_batch(XML_Parser p, const char *templ, int sz, char *src[])
+{
+	struct tmpl	 t;
+	struct batch	 b;
+	size_t		 i, nw, nfail = 0;
+
+	if (!tmpl_parse(p, templ, &t)) {
+		tmpl_free(&t);
+		return 0;
+	}
+
+	nw = jobs_max();
+	memset(&b, 0, sizeof(struct batch));
+	b.tmpl = &t;
+	b.ps = xcalloc(nw, sizeof(XML_Parser));
+	b.ps[0] = p;
+	b.src = src;
+	b.failed = xcalloc(sz, sizeof(int));
+
+	jobs_run(sz, batch_job, &b);
+
+	for (i = 0; i < (size_t)sz; i++)
+		if (b.failed[i]) {
+			ctxwarnx("%s: not compiled", src[i]);
+			nfail++;
+		}
+	if (nfail > 0)
+		ctxwarnx("%zu of %d articles not compiled", nfail, sz);
+
+	for (i = 1; i < nw; i++)
+		if (b.ps[i] != NULL)
+			XML_ParserFree(b.ps[i]);
+	free(b.ps);
+	free(b.failed);
+	tmpl_free(&t);
+	return nfail == 0;
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Number of input files read ahead of the parsers, and the number of
+ * threads reading them, so that the latency of opening files (e.g., on
+ * network volumes) is paid for several at once.
+ */
+#define	PREFETCH_WINDOW	 64
+#define	PREFETCH_READERS 8
+
+/*
+ * Files being read ahead by prefetch_thread().
+ */
+struct	prefetch {
+	pthread_mutex_t	 mtx; /* protects all below */
+	pthread_cond_t	 cond; /* signals "seen" or "stop" */
+	char		**src; /* input files */
+	size_t		 n; /* number of input files */
+	size_t		 next; /* next file to read ahead */
+	size_t		 seen; /* files started by parsers */
+	int		 stop; /* parsing has finished */
+	pthread_t	 thr[PREFETCH_READERS]; /* readers */
+	size_t		 thrsz; /* readers started */
+};
+
+/*
+ * Input files parsed in parallel by corpus_parse().
+ */
+struct	corpus {
+	XML_Parser	 *ps; /* parser per worker (or NULL) */
+	char		**src; /* input files */
+	struct article	**arts; /* articles per file */
+	size_t		 *artsz; /* article count per file */
+	const struct wlist *wl; /* whitelist */
+	int		  flags; /* GROK_xxx */
+	struct prefetch	 *pf; /* read-ahead (or NULL) */
+};
+
+/*
+ * Ask the kernel to start reading "src" into the page cache so that
+ * parsing it later doesn't wait on the disk.
+ * Errors are ignored: they'll be reported when the file is parsed.
+ */
+static void
+prefetch_file(const char *src)
+{
+	int	 fd;
+
+	if ((fd = open(src, O_RDONLY, 0)) == -1)
+		return;
+#ifdef POSIX_FADV_WILLNEED
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+	close(fd);
+}
+
+/*
+ * Read ahead of the parsers, keeping at most PREFETCH_WINDOW files
+ * beyond those already started.
+ * Each of the readers takes the next file in turn.
+ */
+static void *
+prefetch_thread(void *arg)
+{
+	struct prefetch	*pf = arg;
+	size_t		 item;
+
+	pthread_mutex_lock(&pf->mtx);
+	while (!pf->stop && pf->next < pf->n) {
+		if (pf->next >= pf->seen + PREFETCH_WINDOW) {
+			pthread_cond_wait(&pf->cond, &pf->mtx);
+			continue;
+		}
+		item = pf->next++;
+		pthread_mutex_unlock(&pf->mtx);
+		prefetch_file(pf->src[item]);
+		pthread_mutex_lock(&pf->mtx);
+	}
+	pthread_mutex_unlock(&pf->mtx);
+	return NULL;
+}
+
+/*
+ * Note that the parsers have started file "item".
+ */
+static void
+prefetch_seen(struct prefetch *pf, size_t item)
+{
+
+	pthread_mutex_lock(&pf->mtx);
+	if (item + 1 > pf->seen) {
+		pf->seen = item + 1;
+		pthread_cond_broadcast(&pf->cond);
+	}
+	pthread_mutex_unlock(&pf->mtx);
+}
+
+/*
+ * Start reading the "n" files "src" ahead of the parsers.
+ * If no reader can be started, parsing goes on without them.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+prefetch_start(struct prefetch *pf, char **src, size_t n)
+{
+	int	 er;
+
+	memset(pf, 0, sizeof(struct prefetch));
+	pf->src = src;
+	pf->n = n;
+
+	if ((er = pthread_mutex_init(&pf->mtx, NULL)) != 0) {
+		ctxwarnc(er, "pthread_mutex_init");
+		return 0;
+	}
+	if ((er = pthread_cond_init(&pf->cond, NULL)) != 0) {
+		ctxwarnc(er, "pthread_cond_init");
+		pthread_mutex_destroy(&pf->mtx);
+		return 0;
+	}
+
+	for ( ; pf->thrsz < PREFETCH_READERS; pf->thrsz++)
+		if ((er = pthread_create(&pf->thr[pf->thrsz], 
+		    NULL, prefetch_thread, pf)) != 0) {
+			ctxwarnc(er, "pthread_create");
+			break;
+		}
+
+	return 1;
+}
+
+/*
+ * Stop the readers started by prefetch_start().
+ * Return zero on failure, non-zero on success.
+ */
+static int
+prefetch_stop(struct prefetch *pf)
+{
+	size_t	 i;
+	int	 er, rc = 1;
+
+	pthread_mutex_lock(&pf->mtx);
+	pf->stop = 1;
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->mtx);
+
+	for (i = 0; i < pf->thrsz; i++)
+		if ((er = pthread_join(pf->thr[i], NULL)) != 0) {
+			ctxwarnc(er, "pthread_join");
+			rc = 0;
+		}
+
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->mtx);
+	return rc;
+}
+
+static int
+corpus_job(void *arg, size_t worker, size_t item)
+{
+	struct corpus	*c = arg;
+
+	if (c->pf != NULL)
+		prefetch_seen(c->pf, item);
+
+	if (c->ps[worker] == NULL &&
+	    (c->ps[worker] = XML_ParserCreate(NULL)) == NULL) {
+		ctxwarnx("XML_ParserCreate");
+		return 0;
+	}
+	return grok(c->ps[worker], c->src[item],
+		&c->arts[item], &c->artsz[item], c->wl, c->flags);
+}
+
+/*
+ * Parse the "sz" files in "src", each on its own, using all of our
+ * workers, then join the results in order.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+corpus_parse(XML_Parser p, int sz, char *src[],
+	const struct wlist *wl, int flags, struct article **arts,
+	size_t *artsz, size_t **pos)
+{
+	struct corpus	 c;
+	struct prefetch	 pf;
+	size_t		 i, j, n, nw;
+	int		 rc;
+
+	if (sz == 0)
+		return 1;
+
+	/*
+	 * With more files than the window, read ahead of the parsers
+	 * in other threads.
+	 * They only wait on the disk, so they don't take job slots.
+	 */
+
+	if (sz > PREFETCH_WINDOW && !prefetch_start(&pf, src, sz))
+		return 0;
+
+	nw = jobs_max();
+	memset(&c, 0, sizeof(struct corpus));
+	c.ps = xcalloc(nw, sizeof(XML_Parser));
+	c.ps[0] = p;
+	c.src = src;
+	c.arts = xcalloc(sz, sizeof(struct article *));
+	c.artsz = xcalloc(sz, sizeof(size_t));
+	c.wl = wl;
+	c.flags = flags;
+
+	if (sz > PREFETCH_WINDOW && pf.thrsz > 0)
+		c.pf = &pf;
+
+	rc = jobs_run(sz, corpus_job, &c);
+
+	if (sz > PREFETCH_WINDOW && !prefetch_stop(&pf))
+		rc = 0;
+
+	for (i = 1; i < nw; i++)
+		if (c.ps[i] != NULL)
+			XML_ParserFree(c.ps[i]);
+
+	for (i = 0, n = *artsz; i < (size_t)sz; i++)
+		n += c.artsz[i];
+
+	if (n > *artsz) {
+		*arts = xreallocarray(*arts, n, sizeof(struct article));
+		if (pos != NULL)
+			*pos = xreallocarray(*pos, n, sizeof(size_t));
+	}
+
+	/*
+	 * Ordering is by position in the joined array.
+	 * Each file's articles are in the order they're in the file.
+	 */
+
+	for (i = 0; i < (size_t)sz; i++) {
+		for (j = 0; j < c.artsz[i]; j++) {
+			if (pos != NULL)
+				(*pos)[*artsz] = j;
+			c.arts[i][j].order = *artsz;
+			(*arts)[(*artsz)++] = c.arts[i][j];
+		}
+		free(c.arts[i]);
+	}
+
+	free(c.ps);
+	free(c.arts);
+	free(c.artsz);
+	return rc;
+}
+
+/*
+ * Read all articles, either from the summary in "in" or by parsing the
+ * "sz" files in "src".
+ * The "flags" are passed to grok(); articles read from a summary never
+ * have bodies.
+ * Articles are not sorted.
+ * If "pos" is not NULL, it's set to the position of each article within
+ * its file, indexed by the article's order; the caller frees it.
+ * Return zero on failure, non-zero on success.
+ */
+int
+corpus_read(XML_Parser p, const struct input *in, int sz, char *src[],
+	const struct wlist *wl, int flags, struct article **arts,
+	size_t *artsz, size_t **pos)
+{
+
+	if (in->summary != NULL)
+		return summary_read(in->summary, arts, artsz, pos);
+
+	return corpus_parse(p, sz, src, wl, flags, arts, artsz, pos);
+}
+
+static int
+reloadcmp(const void *p1, const void *p2)
+{
+	const struct reload *r1 = p1, *r2 = p2;
+	int	 rc;
+
+	if ((rc = strcmp(r1->art->real, r2->art->real)) != 0)
+		return rc;
+	return r1->pos < r2->pos ? -1 : r1->pos > r2->pos;
+}
+
+/*
+ * Read the bodies of the "sz" articles "arts" again, given their
+ * positions "pos" within their files, parsing each file only once.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+corpus_reload(XML_Parser p, struct article *arts, size_t sz,
+	const size_t *pos, const struct wlist *wl)
+{
+	struct reload	*r;
+	size_t		 i, j;
+	int		 rc = 1;
+
+	if (sz == 0)
+		return 1;
+
+	r = xcalloc(sz, sizeof(struct reload));
+	for (i = 0; i < sz; i++) {
+		r[i].art = &arts[i];
+		r[i].pos = pos[arts[i].order];
+	}
+	qsort(r, sz, sizeof(struct reload), reloadcmp);
+
+	for (i = 0; rc && i < sz; i = j) {
+		for (j = i + 1; j < sz; j++)
+			if (strcmp(r[i].art->real, r[j].art->real))
+				break;
+		rc = grok_reload(p, &r[i], j - i, wl);
+	}
+
+	free(r);
+	return rc;
+}
+
+/*
+ * Read and sort all articles as in corpus_read(), then set the range
+ * of articles to render [*lo, *hi), which is all of them unless a
+ * shard has been selected in "in".
+ * If "in" has a limit, only that many articles are selected (and
+ * sorted) and the rest discarded.
+ * When sharding or limiting, only articles in range are parsed with
+ * bodies; if "in" has GROK_NOBODY, none are.
+ * Return zero on failure, non-zero on success.
+ */
+int
+corpus_load(XML_Parser p, const struct input *in, int sz, char *src[],
+	const struct wlist *wl, enum asort asort, struct article **arts,
+	size_t *artsz, size_t *lo, size_t *hi)
+{
+	size_t	 i, *pos = NULL;
+	int	 rc, flags = in->gflags;
+
+	if (in->shards > 1 || in->limit > 0)
+		flags |= GROK_NOBODY;
+
+	if (!corpus_read(p, in, sz, src, wl, flags, arts, artsz, &pos)) {
+		free(pos);
+		return 0;
+	}
+
+	if (in->limit > 0 && in->limit < *artsz) {
+		sblg_sort_top(*arts, *artsz, in->limit, asort);
+		for (i = in->limit; i < *artsz; i++)
+			article_free(&(*arts)[i]);
+		*artsz = in->limit;
+	} else
+		sblg_sort(*arts, *artsz, asort);
+
+	*lo = 0;
+	*hi = *artsz;
+
+	if (in->shards > 1) {
+		*lo = *artsz * in->shard / in->shards;
+		*hi = *artsz * (in->shard + 1) / in->shards;
+	}
+
+	if ((in->gflags & GROK_NOBODY) ||
+	    (in->summary == NULL && !(flags & GROK_NOBODY))) {
+		free(pos);
+		return 1;
+	}
+
+	rc = corpus_reload(p, *arts + *lo, *hi - *lo, pos, wl);
+	free(pos);
+	return rc;
+}
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * A parsing context for callers of the library.
+ * Each has its own parser, so contexts may be used by different
+ * threads at once.
+ * While a function is using it, running out of memory unwinds to that
+ * function (see ctxoom()).
+ */
+struct	sblg_ctx {
+	XML_Parser	 p; /* parser */
+	sblg_errfn	 errfn; /* error callback (or NULL) */
+	void		*errarg; /* argument to errfn */
+	jmp_buf		 env; /* where ctxoom() returns */
+};
+
+/*
+ * Context of the library function running on this thread, if any, for
+ * its error callback.
+ */
+static	pthread_once_t ctxonce = PTHREAD_ONCE_INIT;
+static	pthread_key_t ctxkey;
+static	int ctxkeyer; /* error creating ctxkey */
+
+static void
+ctx_key(void)
+{
+
+	ctxkeyer = pthread_key_create(&ctxkey, NULL);
+}
+
+/*
+ * Create the key once.
+ * Returns zero if it couldn't be created, non-zero on success.
+ */
+static int
+ctx_init(void)
+{
+
+	return pthread_once(&ctxonce, ctx_key) == 0 && ctxkeyer == 0;
+}
+
+/*
+ * Report the error "er" with message "fmt" to the callback of "ctx",
+ * or to standard error if there's none.
+ */
+static void
+ctx_vreport(const struct sblg_ctx *ctx, int er,
+    const char *fmt, va_list ap)
+{
+	char	 buf[BUFSIZ];
+	size_t	 sz;
+
+	if (ctx == NULL || ctx->errfn == NULL) {
+		if (er)
+			vwarnc(er, fmt, ap);
+		else
+			vwarnx(fmt, ap);
+		return;
+	}
+
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	if (er && (sz = strlen(buf)) < sizeof(buf))
+		snprintf(buf + sz, sizeof(buf) - sz, 
+			": %s", strerror(er));
+	ctx->errfn(ctx->errarg, buf);
+}
+
+static void
+ctx_report(const struct sblg_ctx *ctx, int er, const char *fmt, ...)
+{
+	va_list	 ap;
+
+	va_start(ap, fmt);
+	ctx_vreport(ctx, er, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Make "ctx" (or none, if NULL) the context of this thread.
+ * Its "env" must be set with setjmp() before anything is allocated.
+ * Returns zero on failure, reported to "ctx", non-zero on success.
+ */
+static int
+ctx_set(struct sblg_ctx *ctx)
+{
+	int	 er;
+
+	if (!ctx_init()) {
+		ctx_report(ctx, ctxkeyer, "pthread_key_create");
+		return 0;
+	}
+	if ((er = pthread_setspecific(ctxkey, ctx)) != 0) {
+		ctx_report(ctx, er, "pthread_setspecific");
+		return 0;
+	}
+	return 1;
+}
+
+static void
+ctx_vwarn(int er, const char *fmt, va_list ap)
+{
+
+	ctx_vreport(ctx_init() ?
+		pthread_getspecific(ctxkey) : NULL, er, fmt, ap);
+}
+
+/*
+ * Like warn(3), but passed to the error callback of the context in use
+ * by this thread, if any.
+ */
+void
+ctxwarn(const char *fmt, ...)
+{
+	va_list	 ap;
+	int	 er = errno;
+
+	va_start(ap, fmt);
+	ctx_vwarn(er, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Like warnx(3); see ctxwarn().
+ */
+void
+ctxwarnx(const char *fmt, ...)
+{
+	va_list	 ap;
+
+	va_start(ap, fmt);
+	ctx_vwarn(0, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Like warnc(3); see ctxwarn().
+ */
+void
+ctxwarnc(int er, const char *fmt, ...)
+{
+	va_list	 ap;
+
+	va_start(ap, fmt);
+	ctx_vwarn(er, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Called when memory can't be allocated.
+ * If a library function is using a context on this thread, this is
+ * reported to the context and that function returns failure: what was
+ * allocated by it so far is lost.
+ * Otherwise, as for the command line, we exit.
+ */
+void
+ctxoom(void)
+{
+	struct sblg_ctx	*ctx;
+	int		 er = errno;
+
+	ctx = ctx_init() ? pthread_getspecific(ctxkey) : NULL;
+	if (ctx == NULL)
+		errc(EXIT_FAILURE, er, NULL);
+	ctx_report(ctx, er, "memory allocation");
+	longjmp(ctx->env, 1);
+}
+
+/*
+ * Allocate a context with its own parser.
+ * Returns NULL on allocation failure.
+ */
+struct sblg_ctx *
+sblg_ctx_alloc(void)
+{
+	struct sblg_ctx	*ctx;
+
+	if (!sblg_init() || !ctx_init())
+		return NULL;
+	if ((ctx = calloc(1, sizeof(struct sblg_ctx))) == NULL)
+		return NULL;
+	if ((ctx->p = XML_ParserCreate(NULL)) == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+void
+sblg_ctx_free(struct sblg_ctx *ctx)
+{
+
+	if (ctx == NULL)
+		return;
+	XML_ParserFree(ctx->p);
+	free(ctx);
+}
+
+/*
+ * Pass error messages of functions using "ctx" to "fn" with "arg"
+ * instead of writing them to standard error.
+ * If "fn" is NULL, messages are again written to standard error.
+ */
+void
+sblg_ctx_errfn(struct sblg_ctx *ctx, sblg_errfn fn, void *arg)
+{
+
+	ctx->errfn = fn;
+	ctx->errarg = arg;
+}
+
+/*
+ * Like sblg_parse() with the parser of "ctx".
+ */
+int
+sblg_ctx_parse(struct sblg_ctx *ctx, const char *src,
+    struct article **articles, size_t *articlesz, const char **wl)
+{
+	int	 rc;
+
+	if (setjmp(ctx->env) != 0)
+		rc = 0;
+	else if ((rc = ctx_set(ctx)))
+		rc = sblg_parse(ctx->p, src, articles, articlesz, wl);
+	(void)ctx_set(NULL);
+	return rc;
+}
+
+/*
+ * Like sblg_parse_buffer() with the parser of "ctx".
+ */
+int
+sblg_ctx_parse_buffer(struct sblg_ctx *ctx, const char *name,
+    const char *buf, size_t sz, time_t ctime,
+    struct article **articles, size_t *articlesz, const char **wl)
+{
+	int	 rc;
+
+	if (setjmp(ctx->env) != 0)
+		rc = 0;
+	else if ((rc = ctx_set(ctx)))
+		rc = sblg_parse_buffer(ctx->p, name, buf, sz, ctime,
+			articles, articlesz, wl);
+	(void)ctx_set(NULL);
+	return rc;
+}
+
+/*
+ * Like sblg_sort().
+ * Returns zero on failure, non-zero on success.
+ */
+int
+sblg_ctx_sort(struct sblg_ctx *ctx, struct article *p, size_t sz,
+    enum asort asort)
+{
+	int	 rc;
+
+	if (setjmp(ctx->env) != 0)
+		rc = 0;
+	else if ((rc = ctx_set(ctx)))
+		sblg_sort(p, sz, asort);
+	(void)ctx_set(NULL);
+	return rc;
+}
+
+/*
+ * Like sblg_sort_top().
+ * Returns zero on failure, non-zero on success.
+ */
+int
+sblg_ctx_sort_top(struct sblg_ctx *ctx, struct article *p, size_t sz,
+    size_t k, enum asort asort)
+{
+	int	 rc;
+
+	if (setjmp(ctx->env) != 0)
+		rc = 0;
+	else if ((rc = ctx_set(ctx)))
+		sblg_sort_top(p, sz, k, asort);
+	(void)ctx_set(NULL);
+	return rc;
+}
+
+static int
+ctx_render(struct sblg_ctx *ctx, enum sblg_render type,
+    const char *templ, int sz, char *src[], enum asort asort, FILE *f)
+{
+	struct input	 in;
+	struct jsonopts	 jopts;
+
+	memset(&in, 0, sizeof(struct input));
+	in.out = f;
+
+	switch (type) {
+	case SBLG_RENDER_ARTICLE:
+		if (sz == 1)
+			return compile_file(ctx->p, templ, src[0], f);
+		ctxwarnx("render needs exactly one article");
+		return 0;
+	case SBLG_RENDER_BLOG:
+		return linkall(ctx->p, templ, NULL, 
+			&in, sz, src, "-", asort);
+	case SBLG_RENDER_ATOM:
+		return atom(ctx->p, templ, &in, sz, src, "-", asort);
+	case SBLG_RENDER_JSON:
+		memset(&jopts, 0, sizeof(struct jsonopts));
+		jopts.fields = JSON_ALL;
+		return json(ctx->p, &in, sz, src, "-", asort, &jopts);
+	}
+
+	return 0;
+}
+
+/*
+ * Render the "sz" files in "src" as "type" with template "templ", which
+ * isn't used for SBLG_RENDER_JSON, sorting articles by "asort".
+ * SBLG_RENDER_ARTICLE needs exactly one file.
+ * The output is passed whole to "fn" with "arg" on success.
+ * Returns zero on failure (including if "fn" fails), non-zero on
+ * success.
+ */
+int
+sblg_ctx_render(struct sblg_ctx *ctx, enum sblg_render type,
+    const char *templ, int sz, char *src[], enum asort asort,
+    sblg_writefn fn, void *arg)
+{
+	FILE		*f;
+	char		*buf = NULL;
+	size_t		 bufsz = 0;
+	int		 rc;
+
+	if (!ctx_set(ctx))
+		return 0;
+
+	if ((f = open_memstream(&buf, &bufsz)) == NULL) {
+		ctxwarn("open_memstream");
+		(void)ctx_set(NULL);
+		return 0;
+	}
+
+	if (setjmp(ctx->env) != 0)
+		rc = 0;
+	else
+		rc = ctx_render(ctx, type, templ, sz, src, asort, f);
+
+	if (fclose(f) == EOF) {
+		ctxwarn("fclose");
+		rc = 0;
+	}
+	if (rc && !fn(arg, buf, bufsz))
+		rc = 0;
+
+	free(buf);
+	(void)ctx_set(NULL);
+	return rc;
+}
+
+/*
+ * A sblg_writefn appending to the struct sblg_buf "arg", whose buffer
+ * is kept NUL-terminated and must be freed by the caller.
+ */
+int
+sblg_buf_write(void *arg, const char *data, size_t sz)
+{
+	struct sblg_buf	*b = arg;
+	size_t		 max;
+	void		*p;
+
+	if (b->sz + sz + 1 > b->max) {
+		max = b->max < 1024 ? 1024 : b->max;
+		while (b->sz + sz + 1 > max)
+			max *= 2;
+		if ((p = realloc(b->buf, max)) == NULL)
+			return 0;
+		b->buf = p;
+		b->max = max;
+	}
+	memcpy(b->buf + b->sz, data, sz);
+	b->sz += sz;
+	b->buf[b->sz] = '\0';
+	return 1;
+}
@@ -28,24 +28,230 @@ enum	xmlesc {
 	XMLESC_HTML = 0x04
 };
 
-int	atom(XML_Parser p, const char *templ, int sz, 
-		char *src[], const char *dst, enum asort asort);
-int	json(XML_Parser p, int sz, 
-		char *src[], const char *dst, enum asort asort);
-int	listtags(XML_Parser, int, char *[], int, int, int);
+/*
+ * A white-list of attribute names compiled for wlist_find().
+ * Names are sorted by length then case-insensitively, and those of each
+ * length are between "lens[len]" and "lens[len + 1]".
+ */
+struct	wlist {
+	const char	**names; /* sorted names */
+	size_t		 *lens; /* first name of each length */
+	size_t		  maxlen; /* longest name */
+};
+
+/*
+ * Tags numbered in order of addition with tagtab_get().
+ * This is an open-addressed table of tag numbers, resized to stay at
+ * most half full.
+ */
+struct	tagtab {
+	size_t		 *slots; /* tag numbers or SIZE_MAX */
+	size_t		  slotsz; /* number of slots (power of two) */
+	const char	**tags; /* tags by number */
+	size_t		  tagsz; /* number of tags */
+	size_t		  tagmax; /* allocated tags */
+};
+
+/*
+ * Parse events of an article recorded once by grok() and replayed into
+ * its markup and text (see tape.c).
+ */
+struct	tape {
+	char		 *buf; /* records */
+	size_t		  sz; /* size of records */
+	size_t		  max; /* allocated records */
+	struct tagtab	  names; /* element and attribute names */
+	const XML_Char	**atts; /* attributes when replaying */
+	size_t		  attsmax; /* allocated attributes */
+};
+
+/*
+ * An input file read with zread(), decompressing it if need be.
+ */
+enum	ztype {
+	ZREAD_PLAIN = 0, /* as-is */
+	ZREAD_GZIP, /* gzip (with zlib) */
+	ZREAD_ZSTD /* zstd (with libzstd) */
+};
+
+struct	zread {
+	int		  fd; /* underlying descriptor */
+	const char	 *src; /* underlying file */
+	enum ztype	  type; /* compression */
+	void		 *dec; /* decompressor state */
+	size_t		  decleft; /* decompressor wants more */
+	char		 *in; /* read from file */
+	size_t		  insz; /* bytes in "in" */
+	size_t		  inoff; /* bytes consumed from "in" */
+	int		  eof; /* file has been read */
+	int		  done; /* decompression has finished */
+};
+
+/*
+ * Order of tags in tag-major listings (-O).
+ */
+enum	tagorder {
+	TAGORDER_FIRST = 0, /* first appearance */
+	TAGORDER_NAME, /* by name */
+	TAGORDER_COUNT /* most referenced first, then by name */
+};
+
+/*
+ * Where articles are read from and which slice of the sorted articles
+ * is rendered.
+ * See corpus_load().
+ */
+struct	input {
+	const char	*summary; /* summary (-i) or NULL */
+	size_t		 shard; /* shard to render (from zero) */
+	size_t		 shards; /* number of shards (-S) or zero */
+	size_t		 limit; /* only the first sorted (-n) or zero */
+	int		 gflags; /* GROK_xxx flags */
+	FILE		*out; /* output instead of a file or NULL */
+};
+
+#define	GROK_NOBODY	 0x01 /* don't record article bodies */
+#define	GROK_SPLIT	 0x02 /* stdin is NUL-separated documents */
+
+/*
+ * An article read again by grok_reload().
+ */
+struct	reload {
+	struct article	*art; /* article to fill in */
+	size_t		 pos; /* position within its file */
+};
+
+/*
+ * Fields of articles in JSON output.
+ */
+#define	JSON_SRC	  0x0001
+#define	JSON_BASE	  0x0002
+#define	JSON_STRIPBASE	  0x0004
+#define	JSON_STRIPLANGBASE 0x0008
+#define	JSON_TIME	  0x0010
+#define	JSON_TITLE_TEXT	  0x0020
+#define	JSON_TITLE_XML	  0x0040
+#define	JSON_ASIDE_TEXT	  0x0080
+#define	JSON_ASIDE_XML	  0x0100
+#define	JSON_AUTHOR_TEXT  0x0200
+#define	JSON_AUTHOR_XML	  0x0400
+#define	JSON_ARTICLE	  0x0800
+#define	JSON_TAGS	  0x1000
+#define	JSON_KEYS	  0x2000
+#define	JSON_ALL	  0x3fff
+
+/*
+ * How JSON is written by json().
+ */
+struct	jsonopts {
+	unsigned int	 fields; /* JSON_xxx fields (-f) */
+	size_t		 split; /* articles per shard (-J) or zero */
+	int		 ndjson; /* newline-delimited (-jj) */
+	int		 ndhead; /* ...with version line (-jjj) */
+};
+
+/*
+ * A unit of work for jobs_run(): argument, worker number, and item.
+ * Returns zero on failure, non-zero on success.
+ */
+typedef	int (*jobfn)(void *, size_t, size_t);
+
+/*
+ * Writes an item for jobs_print(): output, argument, and item.
+ */
+typedef	void (*jobprintfn)(FILE *, void *, size_t);
+
+int	atom(XML_Parser p, const char *templ, const struct input *in,
+		int sz, char *src[], const char *dst, enum asort asort);
+int	binary(XML_Parser, const struct input *, int, char *[],
+		const char *, enum asort);
+int	json(XML_Parser p, const struct input *in, int sz, 
+		char *src[], const char *dst, enum asort asort,
+		const struct jsonopts *opts);
+int	json_fields(const char *, unsigned int *);
+int	listtags(XML_Parser, const struct input *,
+		int, char *[], int, int, int, enum tagorder, int);
 int	compile(XML_Parser p, const char *templ,
 		const char *src, const char *dst);
+int	compile_batch(XML_Parser, const char *, int, char *[]);
+int	compile_file(XML_Parser, const char *, const char *, FILE *);
 int	linkall(XML_Parser p, const char *templ, const char *force, 
-		int sz, char *src[], const char *dst, enum asort asort);
+		const struct input *in, int sz, char *src[],
+		const char *dst, enum asort asort);
 int	linkall_r(XML_Parser p, const char *templ, 
-		int sz, char *src[], enum asort asort);
+		const struct input *in, int sz, char *src[],
+		enum asort asort);
+int	merge(int, char *[], const char *, int);
+int	summary(XML_Parser, int, char *[], const char *, enum asort);
+
+void	article_free(struct article *);
+void	article_sort_index(const struct article *, size_t,
+		enum asort, size_t *);
+
+int	corpus_load(XML_Parser, const struct input *, int, char *[],
+		const struct wlist *, enum asort, struct article **, size_t *,
+		size_t *, size_t *);
+int	corpus_read(XML_Parser, const struct input *, int, char *[],
+		const struct wlist *, int, struct article **, size_t *,
+		size_t **);
+int	grok(XML_Parser, const char *, struct article **, size_t *,
+		const struct wlist *, int);
+void	grok_fill(struct article *, const char *);
+int	grok_reload(XML_Parser, struct reload *, size_t,
+		const struct wlist *);
+void	ctxwarn(const char *, ...)
+		__attribute__((format(printf, 1, 2)));
+void	ctxwarnx(const char *, ...)
+		__attribute__((format(printf, 1, 2)));
+void	ctxwarnc(int, const char *, ...)
+		__attribute__((format(printf, 2, 3)));
+void	ctxoom(void)
+		__attribute__((noreturn));
+
+int	inputs_expand(int *, char ***);
+int	markdown(const char *, const char *, size_t, char **, size_t *);
+int	markdown_name(const char *);
+void	inputs_free(int, char **);
+int	ingest(XML_Parser, const char *, const char *, size_t,
+		struct article **, size_t *, const struct wlist *, int,
+		ssize_t);
+int	tagtab_find(const struct tagtab *, const char *, size_t *);
+void	tagtab_free(struct tagtab *);
+size_t	tagtab_get(struct tagtab *, const char *);
+void	tagtab_ids(struct tagtab *, const struct article *, size_t,
+		size_t **, size_t **);
+void	tape_close(struct tape *, const XML_Char *);
+void	tape_free(struct tape *);
+void	tape_open(struct tape *, const XML_Char *, const XML_Char **);
+void	tape_replay(struct tape *, size_t, size_t,
+		const struct wlist *, int, char **, size_t *);
+void	tape_text(struct tape *, const XML_Char *, int);
+
+int	summary_read(const char *, struct article **, size_t *,
+		size_t **);
+
+void	jobs_free(void);
+void	jobs_init(size_t);
+size_t	jobs_max(void);
+int	jobs_print(FILE *, size_t, size_t, jobprintfn, void *);
+int	jobs_run(size_t, jobfn, void *);
 
 void	mmap_close(int fd, void *buf, size_t sz);
 int	mmap_open(const char *f, int *fd, char **buf, size_t *sz);
+int	mmap_or_stream(const char *f, int *fd, char **buf, size_t *sz);
+
+ssize_t	zread(struct zread *, char *, size_t);
+int	zread_all(struct zread *, char **, size_t *);
+void	zread_free(struct zread *);
+int	zread_init(struct zread *, const char *, int);
+int	zread_magic(const char *, size_t);
+char	*zread_name(const char *);
+
+char	*html_name(const char *);
 
 void	xmlstrclose(char **, size_t *, const XML_Char *);
 void	xmlstropen(char **, size_t *, const XML_Char *,
-		const XML_Char **, const char **);
+		const XML_Char **, const struct wlist *);
 void	xmlstrtext(char **, size_t *, const XML_Char *, int);
 
 int	xmlbool(const XML_Char *s);
@@ -61,12 +267,18 @@ void	xmltextx(FILE *f, const XML_Char *s, const char *,
 void	hashtag(char ***, size_t *, const char *,
 		const struct article *, size_t, ssize_t);
 
+int	 wlist_find(const struct wlist *, const char *);
+void	 wlist_free(struct wlist *);
+void	 wlist_init(struct wlist *, const char **);
+
 void	*xcalloc(size_t, size_t);
 void	*xmalloc(size_t);
 char	*xstrdup(const char *);
 char	*xstrndup(const char *, size_t);
 void	*xrealloc(void *, size_t);
 void	*xreallocarray(void *, size_t, size_t);
+void	 xasprintf(char **, const char *, ...)
+		__attribute__((format(printf, 2, 3)));
 
 __END_DECLS
 
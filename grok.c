@@ -24,7 +24,9 @@
 #endif
 #include <expat.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,11 +56,19 @@ struct	parse {
 #define	PARSE_TITLE	  8 /* we've seen a title */
 #define	PARSE_IMG	  16 /* we've seen an image */
 	unsigned int	  flags;
-	int		  fd; /* underlying descriptor */
+	int		  fd; /* underlying descriptor (or -1) */
+	time_t		  ctime; /* default time if no descriptor */
 	const char	 *src; /* underlying file */
-	const char	**wl; /* whitelist of attributes */
+	const struct wlist *wl; /* whitelist of attributes */
 	enum textmode	  textmode; /* mode to accept text */
 	char		 *stacktag; /* tag starting article or NULL */
+	int		  gflags; /* GROK_xxx flags */
+	ssize_t		  only; /* only record this body (or -1) */
+	size_t		  pos; /* articles seen in file */
+	size_t		  articlemax; /* allocated articles */
+	int		  nobody; /* not recording current body */
+	struct tape	  tape; /* events of current article */
+	size_t		  region; /* tape start of title, etc. */
 };
 
 static void article_begin(void *, const XML_Char *, const XML_Char **);
@@ -77,7 +87,7 @@ logerrx(const struct parse *p, const char *fmt, ...)
 	vsnprintf(buf, sizeof(buf), fmt, ap);
 	va_end(ap);
 
-	warnx("%s:%zu:%zu: %s", p->src, 
+	ctxwarnx("%s:%zu:%zu: %s", p->src, 
 		XML_GetCurrentLineNumber(p->p),
 		XML_GetCurrentColumnNumber(p->p), buf);
 }
@@ -120,38 +130,64 @@ string2tm(const char *cp, struct tm *tm, int *datetime)
 	return tm;
 }
 
+/*
+ * Events are recorded on the tape for the body and for the title,
+ * aside, and author regions.
+ * When only collecting metadata, only the regions are recorded.
+ */
+static int
+recording(const struct parse *arg)
+{
+
+	return !arg->nobody || 
+		(arg->textmode != TEXT_ARTICLE && 
+		 arg->textmode != TEXT_NONE);
+}
+
+static void
+body_text(struct parse *arg, const XML_Char *s, int len)
+{
+
+	if (recording(arg))
+		tape_text(&arg->tape, s, len);
+}
+
+static void
+body_open(struct parse *arg, const XML_Char *s, const XML_Char **atts)
+{
+
+	if (recording(arg))
+		tape_open(&arg->tape, s, atts);
+}
+
+static void
+body_close(struct parse *arg, const XML_Char *s)
+{
+
+	if (recording(arg))
+		tape_close(&arg->tape, s);
+}
+
+/*
+ * Append the region recorded from its start to "end" as markup to "p"
+ * and as text to "tp".
+ */
+static void
+region_end(struct parse *arg, size_t end, 
+	char **p, size_t *sz, char **tp, size_t *tsz)
+{
+
+	tape_replay(&arg->tape, arg->region, end, arg->wl, 0, p, sz);
+	tape_replay(&arg->tape, arg->region, end, NULL, 1, tp, tsz);
+}
+
 static void
 text(void *dat, const XML_Char *s, int len)
 {
 	struct parse	*arg = dat;
 
-	switch (arg->textmode) {
-	case TEXT_NONE:
-		return;
-	case TEXT_TITLE:
-		xmlstrtext(&arg->article->title, 
-			&arg->article->titlesz, s, len);
-		xmlstrtext(&arg->article->titletext, 
-			&arg->article->titletextsz, s, len);
-		break;
-	case TEXT_ADDR:
-		xmlstrtext(&arg->article->author, 
-			&arg->article->authorsz, s, len);
-		xmlstrtext(&arg->article->authortext, 
-			&arg->article->authortextsz, s, len);
-		break;
-	case TEXT_ASIDE:
-		xmlstrtext(&arg->article->aside, 
-			&arg->article->asidesz, s, len);
-		xmlstrtext(&arg->article->asidetext, 
-			&arg->article->asidetextsz, s, len);
-		break;
-	default:
-		break;
-	}
-
-	xmlstrtext(&arg->article->article, 
-		&arg->article->articlesz, s, len);
+	if (arg->textmode != TEXT_NONE)
+		body_text(arg, s, len);
 }
 
 static void
@@ -172,22 +208,25 @@ static void
 title_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
+	size_t		 end = arg->tape.sz;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	switch (sblg_lookup(s)) {
 	case SBLG_ELEM_H1:
 	case SBLG_ELEM_H2:
 	case SBLG_ELEM_H3:
 	case SBLG_ELEM_H4:
+		region_end(arg, end,
+			&arg->article->title, &arg->article->titlesz,
+			&arg->article->titletext, 
+			&arg->article->titletextsz);
 		XML_SetElementHandler(arg->p, 
 			article_begin, article_end);
 		arg->textmode = TEXT_ARTICLE;
 		break;
 	default:
-		xmlstrclose(&arg->article->title, 
-			&arg->article->titlesz, s);
+		break;
 	}
 }
 
@@ -195,34 +234,38 @@ static void
 aside_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
+	size_t		 end = arg->tape.sz;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	if (sblg_lookup(s) == SBLG_ELEM_ASIDE && --arg->stack == 0) {
+		region_end(arg, end,
+			&arg->article->aside, &arg->article->asidesz,
+			&arg->article->asidetext, 
+			&arg->article->asidetextsz);
 		XML_SetElementHandler(arg->p, 
 			article_begin, article_end);
 		arg->textmode = TEXT_ARTICLE;
-	} else
-		xmlstrclose(&arg->article->aside, 
-			&arg->article->asidesz, s);
+	}
 }
 
 static void
 addr_end(void *dat, const XML_Char *s)
 {
 	struct parse	*arg = dat;
+	size_t		 end = arg->tape.sz;
 
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
+	body_close(arg, s);
 
 	if (sblg_lookup(s) == SBLG_ELEM_ADDRESS && --arg->stack == 0) {
+		region_end(arg, end,
+			&arg->article->author, &arg->article->authorsz,
+			&arg->article->authortext, 
+			&arg->article->authortextsz);
 		XML_SetElementHandler(arg->p, 
 			article_begin, article_end);
 		arg->textmode = TEXT_ARTICLE;
-	} else
-		xmlstrclose(&arg->article->author, 
-			&arg->article->authorsz, s);
+	}
 }
 
 static void
@@ -271,6 +314,8 @@ tsearch(struct parse *arg, const XML_Char *s, const XML_Char **atts)
 			arg->article->asidetextsz = 
 				arg->article->asidesz =
 				strlen(arg->article->asidetext);
+			if (arg->textmode == TEXT_ASIDE)
+				arg->region = arg->tape.sz;
 			arg->flags |= PARSE_ASIDE;
 			break;
 		case SBLG_ATTR_CONST_AUTHOR:
@@ -285,6 +330,8 @@ tsearch(struct parse *arg, const XML_Char *s, const XML_Char **atts)
 			arg->article->authortextsz = 
 				arg->article->authorsz =
 				strlen(arg->article->author);
+			if (arg->textmode == TEXT_ADDR)
+				arg->region = arg->tape.sz;
 			arg->flags |= PARSE_ADDR;
 			break;
 		case SBLG_ATTR_CONST_IMG:
@@ -313,6 +360,8 @@ tsearch(struct parse *arg, const XML_Char *s, const XML_Char **atts)
 			arg->article->titletextsz = 
 				arg->article->titlesz =
 				strlen(arg->article->titletext);
+			if (arg->textmode == TEXT_TITLE)
+				arg->region = arg->tape.sz;
 			arg->flags |= PARSE_TITLE;
 			break;
 		case SBLG_ATTR_CONST_DATETIME:
@@ -348,10 +397,7 @@ title_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct parse	*arg = dat;
 
 	arg->stack += (sblg_lookup(s) == SBLG_ELEM_TITLE);
-	xmlstropen(&arg->article->title, 
-		&arg->article->titlesz, s, atts, arg->wl);
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts, arg->wl);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 }
 
@@ -361,10 +407,7 @@ addr_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct parse	*arg = dat;
 
 	arg->stack += (sblg_lookup(s) == SBLG_ELEM_ADDRESS);
-	xmlstropen(&arg->article->author, 
-		&arg->article->authorsz, s, atts, arg->wl);
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts, arg->wl);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 }
 
@@ -374,10 +417,7 @@ aside_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	struct parse	*arg = dat;
 
 	arg->stack += (sblg_lookup(s) == SBLG_ELEM_ASIDE);
-	xmlstropen(&arg->article->aside, 
-		&arg->article->asidesz, s, atts, arg->wl);
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts, arg->wl);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 }
 
@@ -395,8 +435,7 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 
 	assert(arg->stack == 0);
 
-	xmlstropen(&arg->article->article,
-		&arg->article->articlesz, s, atts, arg->wl);
+	body_open(arg, s, atts);
 	tsearch(arg, s, atts);
 
 	assert(arg->stacktag != NULL);
@@ -409,6 +448,7 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 		arg->stack++;
 		arg->flags |= PARSE_ASIDE;
 		arg->textmode = TEXT_ASIDE;
+		arg->region = arg->tape.sz;
 		XML_SetElementHandler(arg->p, aside_begin, aside_end);
 		break;
 	case SBLG_ELEM_IMG:
@@ -445,6 +485,7 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 		assert(arg->stack == 0);
 		arg->stack++;
 		arg->textmode = TEXT_ADDR;
+		arg->region = arg->tape.sz;
 		XML_SetElementHandler(arg->p, addr_begin, addr_end);
 		break;
 	case SBLG_ELEM_H1:
@@ -455,6 +496,7 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 			return;
 		arg->flags |= PARSE_TITLE;
 		arg->textmode = TEXT_TITLE;
+		arg->region = arg->tape.sz;
 		XML_SetElementHandler(arg->p, title_begin, title_end);
 		break;
 	default:
@@ -462,125 +504,145 @@ article_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	}
 }
 
-static void
-article_end(void *dat, const XML_Char *s)
+/*
+ * Fill in the names derived from an article's source and the "real"
+ * file it was read from, and default title, author, and aside.
+ * Names already set are left as-is, with the exception of "stripsrc"
+ * and the "real" names, which are always set.
+ * The source must be set.
+ */
+void
+grok_fill(struct article *art, const char *real)
 {
-	struct parse	*arg = dat;
-	char		*cp;
-	struct stat	 st;
-
-	xmlstrclose(&arg->article->article,
-		&arg->article->articlesz, s);
-
-	assert(arg->stacktag != NULL);
-	if (strcmp(s, arg->stacktag) != 0 || --arg->gstack != 0)
-		return;
-
-	free(arg->stacktag);
-	arg->stacktag = NULL;
-	arg->textmode = TEXT_NONE;
-	XML_SetElementHandler(arg->p, input_begin, NULL);
-
-	/* Set source to "real" by default. */
-
-	if (arg->article->src == NULL)
-		arg->article->src = xstrdup(arg->src);
+	char	*cp;
 
 	/* Configure the "base" value and its derivatives. */
 
-	arg->article->base = xstrdup(arg->article->src);
-
-	if ((cp = strrchr(arg->article->src, '/')) == NULL) {
-		arg->article->stripbase = xstrdup(arg->article->src);
-		arg->article->stripsrc = xstrdup(arg->article->src);
-	} else {
-		arg->article->stripbase = xstrdup(cp + 1);
-		arg->article->stripsrc = xstrdup(cp + 1);
-	}
-
-	if ((cp = strrchr(arg->article->src, '/')) == NULL)
-		arg->article->striplangbase = xstrdup(arg->article->src);
+	if ((cp = strrchr(art->src, '/')) == NULL)
+		art->stripsrc = xstrdup(art->src);
 	else
-		arg->article->striplangbase = xstrdup(cp + 1);
+		art->stripsrc = xstrdup(cp + 1);
 
-	if ((cp = strrchr(arg->article->base, '.')) != NULL)
-		if (strchr(cp, '/') == NULL)
-			*cp = '\0';
-	if ((cp = strrchr(arg->article->stripbase, '.')) != NULL)
-		if (strchr(cp, '/') == NULL)
-			*cp = '\0';
-	if ((cp = strrchr(arg->article->striplangbase, '.')) != NULL)
-		if (strchr(cp, '/') == NULL)
-			*cp = '\0';
+	if (art->base == NULL) {
+		art->base = xstrdup(art->src);
+		if ((cp = strrchr(art->base, '.')) != NULL)
+			if (strchr(cp, '/') == NULL)
+				*cp = '\0';
+	}
+	if (art->stripbase == NULL) {
+		art->stripbase = xstrdup(art->stripsrc);
+		if ((cp = strrchr(art->stripbase, '.')) != NULL)
+			if (strchr(cp, '/') == NULL)
+				*cp = '\0';
+	}
+	if (art->striplangbase == NULL) {
+		art->striplangbase = xstrdup(art->stripsrc);
+		if ((cp = strrchr(art->striplangbase, '.')) != NULL)
+			if (strchr(cp, '/') == NULL)
+				*cp = '\0';
+	}
 
-	/* Configure the "real" value and its derivatives. */
+	/*
+	 * Configure the "real" value and its derivatives.
+	 * The real value is the file itself, but its derivatives are
+	 * as if any compression suffix were stripped.
+	 */
 
-	arg->article->real = xstrdup(arg->src);
-	arg->article->realbase = xstrdup(arg->article->real);
+	art->real = xstrdup(real);
+	art->realbase = zread_name(art->real);
 
-	if ((cp = strrchr(arg->article->real, '/')) == NULL) {
-		arg->article->striprealbase = xstrdup(arg->article->real);
-		arg->article->stripreal = xstrdup(arg->article->real);
+	if ((cp = strrchr(art->realbase, '/')) == NULL) {
+		art->striprealbase = xstrdup(art->realbase);
+		art->stripreal = xstrdup(art->realbase);
 	} else {
-		arg->article->striprealbase = xstrdup(cp + 1);
-		arg->article->stripreal = xstrdup(cp + 1);
+		art->striprealbase = xstrdup(cp + 1);
+		art->stripreal = xstrdup(cp + 1);
 	}
 
-	if ((cp = strrchr(arg->article->real, '/')) == NULL)
-		arg->article->striplangrealbase = xstrdup(arg->article->real);
+	if ((cp = strrchr(art->realbase, '/')) == NULL)
+		art->striplangrealbase = xstrdup(art->realbase);
 	else
-		arg->article->striplangrealbase = xstrdup(cp + 1);
+		art->striplangrealbase = xstrdup(cp + 1);
 
-	if ((cp = strrchr(arg->article->realbase, '.')) != NULL)
+	if ((cp = strrchr(art->realbase, '.')) != NULL)
 		if (strchr(cp, '/') == NULL)
 			*cp = '\0';
-	if ((cp = strrchr(arg->article->striprealbase, '.')) != NULL)
+	if ((cp = strrchr(art->striprealbase, '.')) != NULL)
 		if (strchr(cp, '/') == NULL)
 			*cp = '\0';
-	if ((cp = strrchr(arg->article->striplangrealbase, '.')) != NULL)
+	if ((cp = strrchr(art->striplangrealbase, '.')) != NULL)
 		if (strchr(cp, '/') == NULL)
 			*cp = '\0';
 
 	/* Configure title. */
 
-	if (arg->article->title == NULL) {
-		assert(arg->article->titletext == NULL);
-		arg->article->title = xstrdup("Untitled article");
-		arg->article->titlesz = strlen(arg->article->title);
-		arg->article->titletext = xstrdup("Untitled article");
-		arg->article->titletextsz = 
-			strlen(arg->article->titletext);
+	if (art->title == NULL) {
+		assert(art->titletext == NULL);
+		art->title = xstrdup("Untitled article");
+		art->titlesz = strlen(art->title);
+		art->titletext = xstrdup("Untitled article");
+		art->titletextsz = strlen(art->titletext);
 	}
 
 	/* Configure author. */
 
-	if (arg->article->author == NULL) {
-		assert(arg->article->authortext == NULL);
-		arg->article->author = xstrdup("Untitled author");
-		arg->article->authorsz = strlen(arg->article->author);
-		arg->article->authortext = xstrdup("Untitled author");
-		arg->article->authortextsz = 
-			strlen(arg->article->authortext);
+	if (art->author == NULL) {
+		assert(art->authortext == NULL);
+		art->author = xstrdup("Untitled author");
+		art->authorsz = strlen(art->author);
+		art->authortext = xstrdup("Untitled author");
+		art->authortextsz = strlen(art->authortext);
+	}
+
+	/* Configure aside. */
+
+	if (art->aside == NULL) {
+		assert(art->asidetext == NULL);
+		art->aside = xstrdup("");
+		art->asidetext = xstrdup("");
+		art->asidesz = art->asidetextsz = 0;
 	}
+}
+
+static void
+article_end(void *dat, const XML_Char *s)
+{
+	struct parse	*arg = dat;
+	struct stat	 st;
+
+	body_close(arg, s);
+
+	assert(arg->stacktag != NULL);
+	if (strcmp(s, arg->stacktag) != 0 || --arg->gstack != 0)
+		return;
+
+	free(arg->stacktag);
+	arg->stacktag = NULL;
+	arg->textmode = TEXT_NONE;
+
+	if (!arg->nobody)
+		tape_replay(&arg->tape, 0, arg->tape.sz, arg->wl, 0,
+			&arg->article->article, &arg->article->articlesz);
+	XML_SetElementHandler(arg->p, input_begin, NULL);
+
+	/* Set source to "real" by default. */
+
+	if (arg->article->src == NULL)
+		arg->article->src = zread_name(arg->src);
+
+	grok_fill(arg->article, arg->src);
 
 	/* Configure datetime. */
 
 	if (arg->article->time == 0) {
 		arg->article->isdatetime = 1;
-		if (fstat(arg->fd, &st) == -1)
-			warn("%s", arg->article->src);
+		if (arg->fd == -1)
+			arg->article->time = arg->ctime;
+		else if (fstat(arg->fd, &st) == -1)
+			ctxwarn("%s", arg->article->src);
 		else
 			arg->article->time = st.st_ctime;
 	}
-
-	/* Configure aside. */
-
-	if (arg->article->aside == NULL) {
-		assert(arg->article->asidetext == NULL);
-		arg->article->aside = xstrdup("");
-		arg->article->asidetext = xstrdup("");
-		arg->article->asidesz = arg->article->asidetextsz = 0;
-	}
 }
 
 /*
@@ -620,15 +682,22 @@ input_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	arg->stack = 0;
 	arg->gstack = 0;
 
-	*arg->articles = xreallocarray
-		(*arg->articles, 
-		 *arg->articlesz + 1,
-		 sizeof(struct article));
+	/* Grow geometrically: files may hold many articles. */
+
+	if (*arg->articlesz == arg->articlemax) {
+		arg->articlemax = arg->articlemax < 4 ? 
+			4 : arg->articlemax * 2;
+		*arg->articles = xreallocarray(*arg->articles, 
+			arg->articlemax, sizeof(struct article));
+	}
 	arg->article = &(*arg->articles)[*arg->articlesz];
 	(*arg->articlesz)++;
 	memset(arg->article, 0, sizeof(struct article));
 
 	arg->article->order = *arg->articlesz;
+	arg->nobody = (arg->gflags & GROK_NOBODY) ||
+		(arg->only >= 0 && (size_t)arg->only != arg->pos);
+	arg->pos++;
 
 	for (attp = atts; *attp != NULL; attp += 2) 
 		switch (sblg_lookup(*attp)) {
@@ -663,60 +732,495 @@ input_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 
 	arg->gstack = 1;
 	arg->textmode = TEXT_ARTICLE;
+	arg->tape.sz = 0;
 
-	xmlstropen(&arg->article->article, 
-		&arg->article->articlesz, s, atts, arg->wl);
+	body_open(arg, s, atts);
 	XML_SetElementHandler(arg->p, article_begin, article_end);
 	tsearch(arg, s, atts);
 }
 
+/*
+ * Whether the buffer "buf" of size "sz" may contain an article.
+ * Attribute names come verbatim from the document, so those without
+ * the article attribute needn't be parsed.
+ * Documents with a UTF-16 byte order mark or with NUL bytes at the
+ * start (UTF-16 or UTF-32 without a mark) can't be searched this way.
+ */
+static int
+candidate(const char *buf, size_t sz)
+{
+	const unsigned char	*cp = (const unsigned char *)buf;
+
+	if (sz >= 2 && ((cp[0] == 0xfe && cp[1] == 0xff) ||
+	    (cp[0] == 0xff && cp[1] == 0xfe) ||
+	    cp[0] == '\0' || cp[1] == '\0'))
+		return 1;
+	return memmem(buf, sz, "data-sblg-article", 17) != NULL;
+}
+
+/*
+ * Size of chunks read when streaming input.
+ */
+#define	PARSE_CHUNK	 (64 * 1024)
+
+/*
+ * Whether the buffer "buf" of size "sz" is exported JSON.
+ */
+static int
+isjson(const char *buf, size_t sz)
+{
+	size_t	 i;
+
+	for (i = 0; i < sz && isspace((unsigned char)buf[i]); i++)
+		continue;
+	return i < sz && buf[i] == '{';
+}
+
+static void
+parse_init(struct parse *arg, XML_Parser p, const char *src, int fd,
+    struct article **articles, size_t *articlesz,
+    const struct wlist *wl, int flags, ssize_t only)
+{
+
+	memset(arg, 0, sizeof(struct parse));
+	arg->articles = articles;
+	arg->articlesz = articlesz;
+	arg->articlemax = *articlesz;
+	arg->src = src;
+	arg->p = p;
+	arg->fd = fd;
+	arg->wl = wl;
+	arg->textmode = TEXT_NONE;
+	arg->stacktag = NULL;
+	arg->gflags = flags;
+	arg->only = only;
+
+	XML_ParserReset(p, NULL);
+
+	XML_SetDefaultHandlerExpand(p, text);
+	XML_SetStartElementHandler(p, input_begin);
+	XML_SetSkippedEntityHandler(p, entity);
+	XML_SetUserData(p, arg);
+
+	/* Required for entities. */
+
+	XML_UseForeignDTD(p, XML_TRUE);
+}
+
+static void
+parse_free(struct parse *arg)
+{
+
+	free(arg->stacktag);
+	tape_free(&arg->tape);
+}
+
+/*
+ * Like parse(), but reading "src" from "fd" in chunks.
+ * This is for files we can't map whole: pipes and the like, those too
+ * large for a single buffer, and compressed files.
+ * Exported JSON is still read whole.
+ */
+static int
+parse_stream(XML_Parser p, const char *src, int fd,
+    struct article **articles, size_t *articlesz,
+    const struct wlist *wl, int flags, ssize_t only)
+{
+	char		*buf = NULL, *cp;
+	size_t		 sz, max = PARSE_CHUNK;
+	ssize_t		 ssz;
+	struct parse	 arg;
+	struct zread	 z;
+	enum XML_Status	 st;
+	int		 rc = 0;
+
+	if (!zread_init(&z, src, fd))
+		goto out;
+
+	buf = xmalloc(max);
+	if ((ssz = zread(&z, buf, max)) == -1)
+		goto out;
+	sz = ssz;
+
+	if (isjson(buf, sz)) {
+		while (sz == max) {
+			if (max > SIZE_MAX / 2) {
+				ctxwarnx("%s: too large", src);
+				goto out;
+			}
+			buf = xrealloc(buf, max * 2);
+			if ((ssz = zread(&z, buf + sz, max)) == -1)
+				goto out;
+			sz += ssz;
+			max *= 2;
+		}
+		rc = ingest(p, src, buf, sz,
+			articles, articlesz, wl, flags, only);
+		goto out;
+	}
+
+	parse_init(&arg, p, src, fd, articles, articlesz, wl, flags, only);
+
+	/* The first chunk is final if it ended the file. */
+
+	if ((st = XML_Parse(p, buf, sz, sz < max)) != XML_STATUS_OK)
+		logerr(&arg);
+	else if (sz == max)
+		for (;;) {
+			if ((cp = XML_GetBuffer(p, PARSE_CHUNK)) == NULL) {
+				logerr(&arg);
+				st = XML_STATUS_ERROR;
+				break;
+			}
+			if ((ssz = zread(&z, cp, PARSE_CHUNK)) == -1) {
+				st = XML_STATUS_ERROR;
+				break;
+			}
+			st = XML_ParseBuffer(p, ssz, ssz == 0);
+			if (st != XML_STATUS_OK) {
+				logerr(&arg);
+				break;
+			}
+			if (ssz == 0)
+				break;
+		}
+
+	parse_free(&arg);
+	rc = (st == XML_STATUS_OK);
+out:
+	zread_free(&z);
+	free(buf);
+	return rc;
+}
+
+/*
+ * Parse the buffer "buf" of size "sz" holding "src" (see parse()).
+ * Articles without a time take that of "fd", if not -1, or "ctime".
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+parse_buf(XML_Parser p, const char *src, const char *buf, size_t sz,
+    int fd, time_t ctime, struct article **articles, size_t *articlesz,
+    const struct wlist *wl, int flags, ssize_t only)
+{
+	struct parse	 arg;
+	enum XML_Status	 st;
+
+	/* Exported JSON is read as-is. */
+
+	if (isjson(buf, sz))
+		return ingest(p, src, buf, sz,
+			articles, articlesz, wl, flags, only);
+
+	/* Without an article attribute, there's nothing to parse. */
+
+	if (!candidate(buf, sz))
+		return 1;
+
+	if (sz > INT_MAX) {
+		ctxwarnx("%s: too large", src);
+		return 0;
+	}
+
+	parse_init(&arg, p, src, fd, articles, articlesz, wl, flags, only);
+	arg.ctime = ctime;
+
+	if ((st = XML_Parse(p, buf, (int)sz, 1)) != XML_STATUS_OK)
+		logerr(&arg);
+
+	parse_free(&arg);
+	return (st == XML_STATUS_OK);
+}
+
+/*
+ * Parse standard input, named "-".
+ * With GROK_SPLIT, it's read whole and each document separated by a
+ * NUL byte is parsed in turn, with articles lacking a time taking the
+ * current time; otherwise, it's streamed as one document.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+parse_stdin(XML_Parser p, struct article **articles, size_t *articlesz,
+    const struct wlist *wl, int flags)
+{
+	struct zread	 z;
+	char		*buf = NULL, *cp, *end;
+	size_t		 sz = 0;
+	time_t		 now;
+	int		 rc = 0;
+
+	if (!(flags & GROK_SPLIT))
+		return parse_stream(p, "-", STDIN_FILENO,
+			articles, articlesz, wl, flags, -1);
+
+	if (!zread_init(&z, "-", STDIN_FILENO) ||
+	    !zread_all(&z, &buf, &sz))
+		goto out;
+
+	now = time(NULL);
+	for (cp = buf, end = buf + sz; cp < end; cp += sz + 1) {
+		if ((sz = strnlen(cp, end - cp)) == 0)
+			continue;
+		if (!parse_buf(p, "-", cp, sz, -1, now,
+		    articles, articlesz, wl, flags, -1))
+			goto out;
+	}
+	rc = 1;
+out:
+	zread_free(&z);
+	free(buf);
+	return rc;
+}
+
+/*
+ * Parse the Markdown file "src", read whole, as the article rendered
+ * by markdown(), if it's an article at all.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+parse_markdown(XML_Parser p, const char *src,
+    struct article **articles, size_t *articlesz,
+    const struct wlist *wl, int flags, ssize_t only)
+{
+	struct zread	 z;
+	char		*buf, *mem = NULL, *html = NULL;
+	size_t		 sz, htmlsz;
+	int		 fd, rc = 0;
+
+	if (!mmap_or_stream(src, &fd, &buf, &sz))
+		return 0;
+
+	if (buf == NULL || zread_magic(buf, sz)) {
+		mmap_close(-1, buf, sz);
+		rc = zread_init(&z, src, fd) &&
+			zread_all(&z, &mem, &sz);
+		zread_free(&z);
+		buf = mem;
+		if (!rc)
+			goto out;
+	}
+
+	if ((rc = markdown(src, buf, sz, &html, &htmlsz)) && html != NULL)
+		rc = parse_buf(p, src, html, htmlsz, fd, 0,
+			articles, articlesz, wl, flags, only);
+out:
+	if (mem != NULL) {
+		free(mem);
+		mmap_close(fd, NULL, 0);
+	} else
+		mmap_close(fd, buf, sz);
+	free(html);
+	return rc;
+}
+
 /*
  * Main driver for parsing an article at file "src" into (if found) the
  * vector "arg" of current size "argsz".
  * If "wl" is specified, this is used as a white-list of element
  * attributes that we record when parsing into our buffers.
+ * The "flags" are a bit-field of GROK_xxx.
+ * If "only" is not -1, article bodies are recorded only for the
+ * article at that position within the file.
+ * Files that can't be mapped are streamed with parse_stream().
+ * If "src" is "-", standard input is read with parse_stdin().
+ * Markdown files are read with parse_markdown().
  * Returns zero on failure, non-zero on fatal error (file not found, map
  * failure, allocation error, parse error, etc.).
  */
-int
-sblg_parse(XML_Parser p, const char *src, struct article **articles,
-    size_t *articlesz, const char **wl)
+static int
+parse(XML_Parser p, const char *src, struct article **articles,
+    size_t *articlesz, const struct wlist *wl, int flags,
+    ssize_t only)
 {
 	char		*buf;
 	size_t		 sz;
 	int		 fd;
-	struct parse	 arg;
-	enum XML_Status	 st;
+	int		 rc;
 
-	memset(&arg, 0, sizeof(struct parse));
+	if (strcmp(src, "-") == 0)
+		return parse_stdin(p, articles, articlesz, wl, flags);
+	if (markdown_name(src))
+		return parse_markdown(p, src,
+			articles, articlesz, wl, flags, only);
 
-	if (!mmap_open(src, &fd, &buf, &sz))
+	if (!mmap_or_stream(src, &fd, &buf, &sz))
 		return 0;
 
-	arg.articles = articles;
-	arg.articlesz = articlesz;
-	arg.src = src;
-	arg.p = p;
-	arg.fd = fd;
-	arg.wl = wl;
-	arg.textmode = TEXT_NONE;
-	arg.stacktag = NULL;
+	/* Compressed files are decompressed as they're read. */
 
-	XML_ParserReset(p, NULL);
+	if (buf != NULL && zread_magic(buf, sz)) {
+		mmap_close(-1, buf, sz);
+		buf = NULL;
+	}
 
-	XML_SetDefaultHandlerExpand(p, text);
-	XML_SetStartElementHandler(p, input_begin);
-	XML_SetSkippedEntityHandler(p, entity);
-	XML_SetUserData(p, &arg);
+	if (buf == NULL) {
+		rc = parse_stream(p, src, fd,
+			articles, articlesz, wl, flags, only);
+		mmap_close(fd, NULL, 0);
+		return rc;
+	}
 
-	/* Required for entities. */
+	rc = parse_buf(p, src, buf, sz, fd, 0,
+		articles, articlesz, wl, flags, only);
+	mmap_close(fd, buf, sz);
+	return rc;
+}
 
-	XML_UseForeignDTD(p, XML_TRUE);
+/*
+ * Like sblg_parse(), but accepting GROK_xxx "flags".
+ */
+int
+grok(XML_Parser p, const char *src, struct article **articles,
+    size_t *articlesz, const struct wlist *wl, int flags)
+{
 
-	if ((st = XML_Parse(p, buf, (int)sz, 1)) != XML_STATUS_OK)
-		logerr(&arg);
+	return parse(p, src, articles, articlesz, wl, flags, -1);
+}
 
-	mmap_close(fd, buf, sz);
-	free(arg.stacktag);
-	return (st == XML_STATUS_OK);
+static void
+swapstr(char **p1, size_t *sz1, char **p2, size_t *sz2)
+{
+	char	*p;
+	size_t	 sz;
+
+	p = *p1;
+	*p1 = *p2;
+	*p2 = p;
+	sz = *sz1;
+	*sz1 = *sz2;
+	*sz2 = sz;
+}
+
+static void
+dupstr(char **p1, size_t *sz1, const char *p2, size_t sz2)
+{
+
+	free(*p1);
+	*p1 = xstrdup(p2);
+	*sz1 = sz2;
+}
+
+/*
+ * Re-parse the file of the "rsz" articles "r", whose bodies weren't
+ * recorded, e.g., read from a summary or parsed with GROK_NOBODY.
+ * All are from the same file, which is parsed once, and are sorted by
+ * their position within it.
+ * This replaces each article's markup (title, aside, author, body)
+ * with what's in the file, filtering attributes by "wl" if not NULL.
+ * The remaining metadata is left as-is.
+ * Returns zero on failure, non-zero on success.
+ */
+int
+grok_reload(XML_Parser p, struct reload *r, size_t rsz,
+	const struct wlist *wl)
+{
+	struct article	*sargs = NULL, *art, *sv;
+	const char	*real = r[0].art->real;
+	size_t		 i, sargsz = 0;
+	int		 rc = 0;
+
+	if (strcmp(real, "-") == 0) {
+		ctxwarnx("-: standard input can't be read again");
+		return 0;
+	}
+
+	/* With only one article, don't record the others' bodies. */
+
+	if (!parse(p, real, &sargs, &sargsz, 
+	    wl, 0, rsz == 1 ? (ssize_t)r[0].pos : -1))
+		goto out;
+
+	for (i = 0; i < rsz; i++) {
+		art = r[i].art;
+		if (r[i].pos >= sargsz) {
+			ctxwarnx("%s: article %zu not found", 
+				real, r[i].pos + 1);
+			goto out;
+		}
+
+		/* The same file may be given more than once. */
+
+		if (i > 0 && r[i].pos == r[i - 1].pos) {
+			sv = r[i - 1].art;
+			dupstr(&art->title, &art->titlesz,
+				sv->title, sv->titlesz);
+			dupstr(&art->titletext, &art->titletextsz,
+				sv->titletext, sv->titletextsz);
+			dupstr(&art->aside, &art->asidesz,
+				sv->aside, sv->asidesz);
+			dupstr(&art->asidetext, &art->asidetextsz,
+				sv->asidetext, sv->asidetextsz);
+			dupstr(&art->author, &art->authorsz,
+				sv->author, sv->authorsz);
+			dupstr(&art->authortext, &art->authortextsz,
+				sv->authortext, sv->authortextsz);
+			dupstr(&art->article, &art->articlesz,
+				sv->article, sv->articlesz);
+			continue;
+		}
+
+		sv = &sargs[r[i].pos];
+		swapstr(&art->title, &art->titlesz, 
+			&sv->title, &sv->titlesz);
+		swapstr(&art->titletext, &art->titletextsz, 
+			&sv->titletext, &sv->titletextsz);
+		swapstr(&art->aside, &art->asidesz, 
+			&sv->aside, &sv->asidesz);
+		swapstr(&art->asidetext, &art->asidetextsz, 
+			&sv->asidetext, &sv->asidetextsz);
+		swapstr(&art->author, &art->authorsz, 
+			&sv->author, &sv->authorsz);
+		swapstr(&art->authortext, &art->authortextsz, 
+			&sv->authortext, &sv->authortextsz);
+		swapstr(&art->article, &art->articlesz, 
+			&sv->article, &sv->articlesz);
+	}
+	rc = 1;
+out:
+	sblg_free(sargs, sargsz);
+	return rc;
+}
+
+/*
+ * Parse all articles in "src" into "articles".
+ * See parse().
+ */
+int
+sblg_parse(XML_Parser p, const char *src, struct article **articles,
+    size_t *articlesz, const char **wl)
+{
+	struct wlist	 wlist;
+	int		 rc;
+
+	if (wl == NULL)
+		return parse(p, src, articles, articlesz, NULL, 0, -1);
+
+	wlist_init(&wlist, wl);
+	rc = parse(p, src, articles, articlesz, &wlist, 0, -1);
+	wlist_free(&wlist);
+	return rc;
+}
+
+/*
+ * Like sblg_parse(), but parsing the "sz" bytes of "buf" as if read
+ * from file "name".
+ * Articles without a time take "ctime".
+ */
+int
+sblg_parse_buffer(XML_Parser p, const char *name, const char *buf,
+    size_t sz, time_t ctime, struct article **articles,
+    size_t *articlesz, const char **wl)
+{
+	struct wlist	 wlist;
+	int		 rc;
+
+	if (wl == NULL)
+		return parse_buf(p, name, buf, sz, -1, ctime,
+			articles, articlesz, NULL, 0, -1);
+
+	wlist_init(&wlist, wl);
+	rc = parse_buf(p, name, buf, sz, -1, ctime,
+		articles, articlesz, &wlist, 0, -1);
+	wlist_free(&wlist);
+	return rc;
 }
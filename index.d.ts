@@ -103,6 +103,8 @@ export interface sblgDefault extends sblg<sblgKeysDefault>
 
 /**
  * All articles in the set with explicit typing for the articles' keys.
+ * If fields were selected with -f, articles only have those properties
+ * and may be typed with Partial<sblgArticle<Type>>.
  */
 export interface sblg<Type> 
 {
@@ -115,3 +117,60 @@ export interface sblg<Type>
 	 */
 	articles: sblgArticle<Type>[],
 }
+
+/**
+ * An article in the index written with -J, having only what's needed
+ * to list articles.  The full article is in the shard file.
+ */
+export interface sblgIndexArticle
+{
+	/**
+	 * Source filename.
+	 */
+	src: string,
+	/**
+	 * Date of publication (epoch).
+	 */
+	time: number,
+	/**
+	 * Title content.
+	 */
+	title: {
+		/**
+		 * Stripped of HTML tags.
+		 */
+		text: string,
+	},
+	/**
+	 * Tags set in the article.
+	 */
+	tags: string[],
+	/**
+	 * Shard (from zero) holding the full article.  If the index is
+	 * "blog.json", this is in "blog.N.json" as an sblg object.
+	 */
+	shard: number,
+}
+
+/**
+ * Index of all articles written with -J.
+ */
+export interface sblgIndex
+{
+	/**
+	 * Version of sblg producing the JSON.
+	 */
+	version: string,
+	/**
+	 * Number of articles in each shard (the last may have fewer).
+	 */
+	shardsize: number,
+	/**
+	 * Number of shard files.
+	 */
+	shards: number,
+	/**
+	 * Array of articles in the same order as within the shards.
+	 */
+	articles: sblgIndexArticle[],
+}
@@ -0,0 +1,775 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Maximum nesting of skipped JSON values.
+ */
+#define	JSON_MAXDEPTH	 64
+
+/*
+ * Reading a JSON document written by json().
+ */
+struct	jparse {
+	XML_Parser	  p; /* for re-filtering markup */
+	const char	 *src; /* file name */
+	const char	 *buf; /* document */
+	size_t		  sz; /* document length */
+	size_t		  pos; /* position in document */
+	size_t		  line; /* line in document */
+	struct article	**arts; /* articles */
+	size_t		 *artsz; /* number of articles */
+	size_t		  artmax; /* allocated articles */
+	const struct wlist *wl; /* white-list or NULL */
+	int		  flags; /* GROK_xxx */
+	ssize_t		  only; /* only body at position (or -1) */
+	size_t		  apos; /* articles seen in file (with current) */
+};
+
+/*
+ * Used when re-filtering markup through the white-list.
+ */
+struct	jfilter {
+	char		*buf; /* filtered markup */
+	size_t		 bufsz; /* markup length */
+	const struct wlist *wl; /* white-list */
+	size_t		 depth; /* element depth */
+};
+
+static void
+jerr(const struct jparse *jp, const char *msg)
+{
+
+	ctxwarnx("%s:%zu: %s", jp->src, jp->line, msg);
+}
+
+static void
+jws(struct jparse *jp)
+{
+
+	for ( ; jp->pos < jp->sz; jp->pos++)
+		if (jp->buf[jp->pos] == '\n')
+			jp->line++;
+		else if (jp->buf[jp->pos] != ' ' &&
+		    jp->buf[jp->pos] != '\t' &&
+		    jp->buf[jp->pos] != '\r')
+			break;
+}
+
+/*
+ * Skip white-space and check the next character, consuming it if it
+ * matches.
+ * Return zero if it doesn't match, non-zero if it does.
+ */
+static int
+jpeek(struct jparse *jp, char c)
+{
+
+	jws(jp);
+	if (jp->pos < jp->sz && jp->buf[jp->pos] == c) {
+		jp->pos++;
+		return 1;
+	}
+	return 0;
+}
+
+static int
+jexpect(struct jparse *jp, char c)
+{
+	char	 msg[32];
+
+	if (jpeek(jp, c))
+		return 1;
+	snprintf(msg, sizeof(msg), "expected '%c'", c);
+	jerr(jp, msg);
+	return 0;
+}
+
+static int
+jhex(const char *cp, unsigned int *v)
+{
+	size_t	 i;
+
+	for (*v = 0, i = 0; i < 4; i++) {
+		*v <<= 4;
+		if (cp[i] >= '0' && cp[i] <= '9')
+			*v |= cp[i] - '0';
+		else if (cp[i] >= 'a' && cp[i] <= 'f')
+			*v |= cp[i] - 'a' + 10;
+		else if (cp[i] >= 'A' && cp[i] <= 'F')
+			*v |= cp[i] - 'A' + 10;
+		else
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Append the code point "v" as UTF-8.
+ */
+static size_t
+jutf8(char *p, unsigned int v)
+{
+
+	if (v < 0x80) {
+		p[0] = v;
+		return 1;
+	} else if (v < 0x800) {
+		p[0] = 0xc0 | (v >> 6);
+		p[1] = 0x80 | (v & 0x3f);
+		return 2;
+	} else if (v < 0x10000) {
+		p[0] = 0xe0 | (v >> 12);
+		p[1] = 0x80 | ((v >> 6) & 0x3f);
+		p[2] = 0x80 | (v & 0x3f);
+		return 3;
+	}
+	p[0] = 0xf0 | (v >> 18);
+	p[1] = 0x80 | ((v >> 12) & 0x3f);
+	p[2] = 0x80 | ((v >> 6) & 0x3f);
+	p[3] = 0x80 | (v & 0x3f);
+	return 4;
+}
+
+/*
+ * Parse a string.
+ * If "out" is NULL, the string is skipped.
+ * Otherwise, it's set to the NUL-terminated unescaped string and "outsz"
+ * (if not NULL) to its length.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jstr(struct jparse *jp, char **out, size_t *outsz)
+{
+	const char	*cp;
+	char		*p = NULL;
+	size_t		 start, end, i, j;
+	unsigned int	 v, lo;
+
+	if (!jexpect(jp, '"'))
+		return 0;
+
+	/* Find the end, skipping escapes. */
+
+	for (start = end = jp->pos; end < jp->sz; end++)
+		if (jp->buf[end] == '\\')
+			end++;
+		else if (jp->buf[end] == '"')
+			break;
+
+	if (end >= jp->sz) {
+		jerr(jp, "unterminated string");
+		return 0;
+	}
+
+	jp->pos = end + 1;
+	if (out == NULL)
+		return 1;
+
+	/* Unescaping never makes the string longer. */
+
+	cp = jp->buf + start;
+	p = xmalloc(end - start + 1);
+
+	for (i = j = 0; i < end - start; i++) {
+		if (cp[i] != '\\') {
+			if (cp[i] == '\n')
+				jp->line++;
+			p[j++] = cp[i];
+			continue;
+		}
+		switch (cp[++i]) {
+		case 'b':
+			p[j++] = '\b';
+			break;
+		case 'f':
+			p[j++] = '\f';
+			break;
+		case 'n':
+			p[j++] = '\n';
+			break;
+		case 'r':
+			p[j++] = '\r';
+			break;
+		case 't':
+			p[j++] = '\t';
+			break;
+		case 'u':
+			if (i + 4 >= end - start || !jhex(&cp[i + 1], &v))
+				goto bad;
+			i += 4;
+			if (v >= 0xd800 && v < 0xdc00 &&
+			    i + 6 < end - start &&
+			    cp[i + 1] == '\\' && cp[i + 2] == 'u' &&
+			    jhex(&cp[i + 3], &lo) &&
+			    lo >= 0xdc00 && lo < 0xe000) {
+				v = 0x10000 +
+					((v - 0xd800) << 10) + (lo - 0xdc00);
+				i += 6;
+			} else if (v >= 0xd800 && v < 0xe000)
+				goto bad;
+			if (v == 0)
+				goto bad;
+			j += jutf8(&p[j], v);
+			break;
+		default:
+			p[j++] = cp[i];
+			break;
+		}
+	}
+
+	p[j] = '\0';
+	*out = p;
+	if (outsz != NULL)
+		*outsz = j;
+	return 1;
+bad:
+	jerr(jp, "bad string escape");
+	free(p);
+	return 0;
+}
+
+/*
+ * Parse an integer number.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jnum(struct jparse *jp, long long *val)
+{
+	char		 buf[32];
+	const char	*er;
+	size_t		 i;
+
+	jws(jp);
+	for (i = 0; jp->pos < jp->sz && i < sizeof(buf) - 1; i++)
+		if (jp->buf[jp->pos] == '-' ||
+		    (jp->buf[jp->pos] >= '0' && jp->buf[jp->pos] <= '9'))
+			buf[i] = jp->buf[jp->pos++];
+		else
+			break;
+	buf[i] = '\0';
+
+	*val = strtonum(buf, LLONG_MIN, LLONG_MAX, &er);
+	if (er != NULL) {
+		jerr(jp, "bad integer");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Skip any value.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jskip(struct jparse *jp, size_t depth)
+{
+	char	 c;
+
+	if (depth == JSON_MAXDEPTH) {
+		jerr(jp, "nested too deeply");
+		return 0;
+	}
+
+	jws(jp);
+	if (jp->pos == jp->sz) {
+		jerr(jp, "unexpected end of document");
+		return 0;
+	}
+
+	switch ((c = jp->buf[jp->pos])) {
+	case '"':
+		return jstr(jp, NULL, NULL);
+	case '[':
+	case '{':
+		jp->pos++;
+		if (jpeek(jp, c == '[' ? ']' : '}'))
+			return 1;
+		do {
+			if (c == '{' &&
+			    (!jstr(jp, NULL, NULL) || !jexpect(jp, ':')))
+				return 0;
+			if (!jskip(jp, depth + 1))
+				return 0;
+		} while (jpeek(jp, ','));
+		return jexpect(jp, c == '[' ? ']' : '}');
+	default:
+		break;
+	}
+
+	/* Numbers and literals. */
+
+	while (jp->pos < jp->sz &&
+	       strchr("+-.0123456789Eaeflnrstu", jp->buf[jp->pos]) != NULL)
+		jp->pos++;
+	return 1;
+}
+
+static void
+jfilter_text(void *dat, const XML_Char *s, int len)
+{
+	struct jfilter	*f = dat;
+
+	xmlstrtext(&f->buf, &f->bufsz, s, len);
+}
+
+static void
+jfilter_entity(void *dat, const XML_Char *entity, int is_parameter_entity)
+{
+
+	(void)is_parameter_entity;
+	jfilter_text(dat, "&", 1);
+	jfilter_text(dat, entity, strlen(entity));
+	jfilter_text(dat, ";", 1);
+}
+
+static void
+jfilter_begin(void *dat, const XML_Char *s, const XML_Char **atts)
+{
+	struct jfilter	*f = dat;
+
+	if (f->depth++ > 0)
+		xmlstropen(&f->buf, &f->bufsz, s, atts, f->wl);
+}
+
+static void
+jfilter_end(void *dat, const XML_Char *s)
+{
+	struct jfilter	*f = dat;
+
+	if (--f->depth > 0)
+		xmlstrclose(&f->buf, &f->bufsz, s);
+}
+
+/*
+ * Pass the markup "*xml" through the white-list as if it had been read
+ * from XML input, replacing it.
+ * Return zero on failure (bad markup), non-zero on success.
+ */
+static int
+jfilter(struct jparse *jp, char **xml, size_t *xmlsz)
+{
+	struct jfilter	 f;
+	XML_Parser	 p = jp->p;
+
+	if (jp->wl == NULL || *xml == NULL)
+		return 1;
+
+	memset(&f, 0, sizeof(struct jfilter));
+	f.wl = jp->wl;
+
+	/* Wrap in a root element: the markup may be any content. */
+
+	XML_ParserReset(p, NULL);
+	XML_SetDefaultHandlerExpand(p, jfilter_text);
+	XML_SetElementHandler(p, jfilter_begin, jfilter_end);
+	XML_SetSkippedEntityHandler(p, jfilter_entity);
+	XML_SetUserData(p, &f);
+	XML_UseForeignDTD(p, XML_TRUE);
+
+	if (XML_Parse(p, "<sblg>", 6, 0) != XML_STATUS_OK ||
+	    XML_Parse(p, *xml, strlen(*xml), 0) != XML_STATUS_OK ||
+	    XML_Parse(p, "</sblg>", 7, 1) != XML_STATUS_OK) {
+		jerr(jp, "bad markup");
+		free(f.buf);
+		return 0;
+	}
+
+	free(*xml);
+	*xml = f.buf != NULL ? f.buf : xstrdup("");
+	if (xmlsz != NULL)
+		*xmlsz = f.bufsz;
+	return 1;
+}
+
+/*
+ * Strip the markup "xml" down to its text, for markup read without.
+ */
+static char *
+jtext(const char *xml, size_t *sz)
+{
+	char	*p;
+	size_t	 i, j;
+	int	 tag = 0;
+
+	p = xmalloc(strlen(xml) + 1);
+	for (i = j = 0; xml[i] != '\0'; i++)
+		if (xml[i] == '<')
+			tag = 1;
+		else if (xml[i] == '>' && tag)
+			tag = 0;
+		else if (!tag)
+			p[j++] = xml[i];
+	p[j] = '\0';
+	*sz = j;
+	return p;
+}
+
+/*
+ * Escape the text "text" into markup, for text read without.
+ */
+static char *
+jescape(const char *text, size_t *sz)
+{
+	char	*p;
+	size_t	 i, j;
+
+	p = xreallocarray(NULL, strlen(text) + 1, 5);
+	for (i = j = 0; text[i] != '\0'; i++)
+		if (text[i] == '<') {
+			memcpy(&p[j], "&lt;", 4);
+			j += 4;
+		} else if (text[i] == '>') {
+			memcpy(&p[j], "&gt;", 4);
+			j += 4;
+		} else if (text[i] == '&') {
+			memcpy(&p[j], "&amp;", 5);
+			j += 5;
+		} else
+			p[j++] = text[i];
+	p[j] = '\0';
+	*sz = j;
+	return p;
+}
+
+/*
+ * Parse markup objects ("text" and "xml").
+ * If "text" is NULL, the text is skipped.
+ * If "skip" is non-zero, the markup is skipped.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jmarkup(struct jparse *jp, char **xml, size_t *xmlsz,
+	char **text, size_t *textsz, int skip)
+{
+	char	*key;
+	int	 rc;
+
+	if (!jexpect(jp, '{'))
+		return 0;
+	if (jpeek(jp, '}'))
+		return 1;
+
+	do {
+		if (!jstr(jp, &key, NULL))
+			return 0;
+		if (!jexpect(jp, ':')) {
+			free(key);
+			return 0;
+		}
+		if (strcmp(key, "xml") == 0 && !skip) {
+			free(*xml);
+			*xml = NULL;
+			rc = jstr(jp, xml, xmlsz);
+		} else if (strcmp(key, "text") == 0 &&
+		    !skip && text != NULL) {
+			free(*text);
+			*text = NULL;
+			rc = jstr(jp, text, textsz);
+		} else
+			rc = jskip(jp, 0);
+		free(key);
+		if (!rc)
+			return 0;
+	} while (jpeek(jp, ','));
+
+	if (!jexpect(jp, '}'))
+		return 0;
+	if (skip || !jfilter(jp, xml, xmlsz))
+		return !skip ? 0 : 1;
+
+	/* Sorting and feeds need the text if we have markup. */
+
+	if (text != NULL && *text == NULL && *xml != NULL)
+		*text = jtext(*xml, textsz);
+	return 1;
+}
+
+/*
+ * Parse an array of strings ("keys" is zero) or an object of string
+ * values ("keys" is non-zero) into the list "map".
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jlist(struct jparse *jp, char ***map, size_t *mapsz, int keys)
+{
+	char	 c = keys ? '{' : '[';
+	size_t	 n;
+
+	if (!jexpect(jp, c))
+		return 0;
+	if (jpeek(jp, keys ? '}' : ']'))
+		return 1;
+
+	do {
+		n = keys ? 2 : 1;
+		*map = xreallocarray(*map, *mapsz + n, sizeof(char *));
+		if (!jstr(jp, &(*map)[*mapsz], NULL))
+			return 0;
+		(*mapsz)++;
+		if (!keys)
+			continue;
+		if (!jexpect(jp, ':'))
+			return 0;
+		if (!jstr(jp, &(*map)[*mapsz], NULL))
+			return 0;
+		(*mapsz)++;
+	} while (jpeek(jp, ','));
+
+	return jexpect(jp, keys ? '}' : ']');
+}
+
+/*
+ * Parse the member "key" of an article object into "art".
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jmember(struct jparse *jp, struct article *art, const char *key)
+{
+	long long	 t;
+	int		 nobody;
+
+	nobody = (jp->flags & GROK_NOBODY) ||
+		(jp->only >= 0 && (size_t)jp->only != jp->apos - 1);
+
+	if (strcmp(key, "src") == 0) {
+		free(art->src);
+		art->src = NULL;
+		return jstr(jp, &art->src, NULL);
+	} else if (strcmp(key, "base") == 0) {
+		free(art->base);
+		art->base = NULL;
+		return jstr(jp, &art->base, NULL);
+	} else if (strcmp(key, "stripbase") == 0) {
+		free(art->stripbase);
+		art->stripbase = NULL;
+		return jstr(jp, &art->stripbase, NULL);
+	} else if (strcmp(key, "striplangbase") == 0) {
+		free(art->striplangbase);
+		art->striplangbase = NULL;
+		return jstr(jp, &art->striplangbase, NULL);
+	} else if (strcmp(key, "time") == 0) {
+		if (!jnum(jp, &t))
+			return 0;
+		art->time = (time_t)t;
+		art->isdatetime = (t % 86400) != 0;
+		return 1;
+	} else if (strcmp(key, "title") == 0) {
+		return jmarkup(jp, &art->title, &art->titlesz,
+			&art->titletext, &art->titletextsz, 0);
+	} else if (strcmp(key, "aside") == 0) {
+		return jmarkup(jp, &art->aside, &art->asidesz,
+			&art->asidetext, &art->asidetextsz, 0);
+	} else if (strcmp(key, "author") == 0) {
+		return jmarkup(jp, &art->author, &art->authorsz,
+			&art->authortext, &art->authortextsz, 0);
+	} else if (strcmp(key, "article") == 0) {
+		return jmarkup(jp, &art->article,
+			&art->articlesz, NULL, NULL, nobody);
+	} else if (strcmp(key, "tags") == 0)
+		return jlist(jp, &art->tagmap, &art->tagmapsz, 0);
+	else if (strcmp(key, "keys") == 0)
+		return jlist(jp, &art->setmap, &art->setmapsz, 1);
+
+	return jskip(jp, 0);
+}
+
+/*
+ * Allocate a new article.
+ */
+static struct article *
+jarticle(struct jparse *jp)
+{
+	struct article	*art;
+
+	if (*jp->artsz == jp->artmax) {
+		jp->artmax = jp->artmax < 4 ? 4 : jp->artmax * 2;
+		*jp->arts = xreallocarray
+			(*jp->arts, jp->artmax, sizeof(struct article));
+	}
+	art = &(*jp->arts)[*jp->artsz];
+	(*jp->artsz)++;
+	memset(art, 0, sizeof(struct article));
+	art->order = *jp->artsz;
+	jp->apos++;
+	return art;
+}
+
+/*
+ * Finish an article after its members have been read.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jarticle_end(struct jparse *jp, struct article *art)
+{
+
+	if (art->src == NULL) {
+		jerr(jp, "article without src");
+		return 0;
+	}
+
+	/* Text is always with its markup. */
+
+	if (art->title == NULL && art->titletext != NULL)
+		art->title = jescape(art->titletext, &art->titlesz);
+	if (art->author == NULL && art->authortext != NULL)
+		art->author = jescape(art->authortext, &art->authorsz);
+	if (art->aside == NULL && art->asidetext != NULL)
+		art->aside = jescape(art->asidetext, &art->asidesz);
+
+	/* Bodies are always recorded unless asked otherwise. */
+
+	if (art->article == NULL && !(jp->flags & GROK_NOBODY) &&
+	    (jp->only < 0 || (size_t)jp->only == jp->apos - 1))
+		art->article = xstrdup("");
+
+	grok_fill(art, jp->src);
+	return 1;
+}
+
+/*
+ * Parse the articles of the "articles" array.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jarticles(struct jparse *jp)
+{
+	struct article	*art;
+	char		*key;
+	int		 rc;
+
+	if (!jexpect(jp, '['))
+		return 0;
+	if (jpeek(jp, ']'))
+		return 1;
+
+	do {
+		if (!jexpect(jp, '{'))
+			return 0;
+		art = jarticle(jp);
+		if (!jpeek(jp, '}')) {
+			do {
+				if (!jstr(jp, &key, NULL))
+					return 0;
+				rc = jexpect(jp, ':') &&
+					jmember(jp, art, key);
+				free(key);
+				if (!rc)
+					return 0;
+			} while (jpeek(jp, ','));
+			if (!jexpect(jp, '}'))
+				return 0;
+		}
+		if (!jarticle_end(jp, art))
+			return 0;
+	} while (jpeek(jp, ','));
+
+	return jexpect(jp, ']');
+}
+
+/*
+ * Parse a top-level object.
+ * This is either the document (or the first line of newline-delimited
+ * JSON) having "version" and "articles", or an article itself.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jtop(struct jparse *jp)
+{
+	struct article	*art = NULL;
+	char		*key;
+	int		 rc;
+
+	if (!jexpect(jp, '{'))
+		return 0;
+	if (jpeek(jp, '}'))
+		return 1;
+
+	do {
+		if (!jstr(jp, &key, NULL))
+			return 0;
+		if (!jexpect(jp, ':')) {
+			free(key);
+			return 0;
+		}
+		if (art == NULL && strcmp(key, "articles") == 0)
+			rc = jarticles(jp);
+		else if (art == NULL && strcmp(key, "version") == 0)
+			rc = jstr(jp, NULL, NULL);
+		else {
+			if (art == NULL)
+				art = jarticle(jp);
+			rc = jmember(jp, art, key);
+		}
+		free(key);
+		if (!rc)
+			return 0;
+	} while (jpeek(jp, ','));
+
+	if (!jexpect(jp, '}'))
+		return 0;
+	return art == NULL || jarticle_end(jp, art);
+}
+
+/*
+ * Read the articles of a JSON document "buf" of size "sz", as written
+ * with -j or -jj, from the file "src".
+ * Arguments are as for grok(), with "p" being used to re-filter markup
+ * through the white-list "wl".
+ * Return zero on failure, non-zero on success.
+ */
+int
+ingest(XML_Parser p, const char *src, const char *buf, size_t sz,
+	struct article **arts, size_t *artsz, const struct wlist *wl,
+	int flags, ssize_t only)
+{
+	struct jparse	 jp;
+
+	memset(&jp, 0, sizeof(struct jparse));
+	jp.p = p;
+	jp.src = src;
+	jp.buf = buf;
+	jp.sz = sz;
+	jp.line = 1;
+	jp.arts = arts;
+	jp.artsz = artsz;
+	jp.artmax = *artsz;
+	jp.wl = wl;
+	jp.flags = flags;
+	jp.only = only;
+
+	for (;;) {
+		jws(&jp);
+		if (jp.pos == jp.sz)
+			break;
+		if (!jtop(&jp))
+			return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#if HAVE_FTS
+# include <fts.h>
+#endif
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Suffixes of files read from directories, matched without regard to
+ * case after any compression suffix is stripped by zread_name().
+ * Markdown is only collected if we can read it.
+ */
+static	const char *const suffixes[] = {
+	".xml",
+#if HAVE_LOWDOWN
+	".md",
+#endif
+	NULL
+};
+
+/*
+ * Input files being collected by inputs_expand().
+ */
+struct	inputs {
+	char		**files; /* files (allocated) */
+	size_t		  filesz; /* number of files */
+	size_t		  filemax; /* allocated files */
+};
+
+static void
+inputs_add(struct inputs *in, const char *file)
+{
+
+	if (in->filesz + 1 >= in->filemax) {
+		in->filemax = in->filemax < 64 ? 64 : in->filemax * 2;
+		in->files = xreallocarray(in->files, 
+			in->filemax, sizeof(char *));
+	}
+	in->files[in->filesz++] = xstrdup(file);
+	in->files[in->filesz] = NULL;
+}
+
+static int
+inputs_suffix(const char *name)
+{
+	char	*cp;
+	size_t	 i, sz, ssz;
+	int	 rc = 0;
+
+	cp = zread_name(name);
+	sz = strlen(cp);
+	for (i = 0; rc == 0 && suffixes[i] != NULL; i++) {
+		ssz = strlen(suffixes[i]);
+		rc = sz > ssz && 
+			strcasecmp(cp + sz - ssz, suffixes[i]) == 0;
+	}
+	free(cp);
+	return rc;
+}
+
+/*
+ * Directory entries are visited in name order so that the command-line
+ * order of their files is the same from run to run.
+ */
+static int
+inputs_cmp(const FTSENT **e1, const FTSENT **e2)
+{
+
+	return strcmp((*e1)->fts_name, (*e2)->fts_name);
+}
+
+/*
+ * Add the files within directory "dir" having one of our suffixes.
+ * Hidden files and directories are skipped.
+ * Symbolic links to files are added, as they would be if given on the
+ * command line, but those to directories aren't followed; dangling
+ * links are added to be reported when opened.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+inputs_dir(struct inputs *in, const char *dir)
+{
+	FTS		*fts;
+	FTSENT		*ent;
+	struct stat	 st;
+	char		*paths[2];
+	int		 rc = 1;
+
+	paths[0] = (char *)dir;
+	paths[1] = NULL;
+
+	if ((fts = fts_open(paths, 
+	    FTS_PHYSICAL | FTS_NOCHDIR, inputs_cmp)) == NULL) {
+		ctxwarn("%s", dir);
+		return 0;
+	}
+
+	errno = 0;
+	while (rc && (ent = fts_read(fts)) != NULL)
+		switch (ent->fts_info) {
+		case FTS_D:
+			if (ent->fts_level > 0 && 
+			    ent->fts_name[0] == '.')
+				fts_set(fts, ent, FTS_SKIP);
+			break;
+		case FTS_F:
+			if (ent->fts_name[0] != '.' &&
+			    inputs_suffix(ent->fts_name))
+				inputs_add(in, ent->fts_path);
+			break;
+		case FTS_SL:
+		case FTS_SLNONE:
+			if (ent->fts_name[0] == '.' ||
+			    !inputs_suffix(ent->fts_name))
+				break;
+			if (stat(ent->fts_path, &st) == -1 ||
+			    !S_ISDIR(st.st_mode))
+				inputs_add(in, ent->fts_path);
+			break;
+		case FTS_DNR:
+		case FTS_ERR:
+		case FTS_NS:
+			ctxwarnc(ent->fts_errno, "%s", ent->fts_path);
+			rc = 0;
+			break;
+		default:
+			break;
+		}
+
+	if (rc && errno != 0) {
+		ctxwarn("%s", dir);
+		rc = 0;
+	}
+	fts_close(fts);
+	return rc;
+}
+
+/*
+ * Add the input file "file" or, if a directory, the files within it.
+ * Files that don't exist are added as-is, so they're reported when
+ * opened.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+inputs_file(struct inputs *in, const char *file)
+{
+	struct stat	 st;
+
+	if (stat(file, &st) == 0 && S_ISDIR(st.st_mode))
+		return inputs_dir(in, file);
+	inputs_add(in, file);
+	return 1;
+}
+
+/*
+ * Add the files, one per line, listed in "list".
+ * Empty lines are ignored.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+inputs_list(struct inputs *in, const char *list)
+{
+	FILE	*f;
+	char	*line = NULL;
+	size_t	 linesz = 0;
+	ssize_t	 len;
+	int	 rc = 1;
+
+	if ((f = fopen(list, "r")) == NULL) {
+		ctxwarn("%s", list);
+		return 0;
+	}
+
+	while (rc && (len = getline(&line, &linesz, f)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len > 0)
+			rc = inputs_file(in, line);
+	}
+
+	if (rc && ferror(f)) {
+		ctxwarn("%s", list);
+		rc = 0;
+	}
+	free(line);
+	fclose(f);
+	return rc;
+}
+
+/*
+ * Expand the "argc" input files in "argv": arguments "@list" are
+ * replaced by the files listed in "list", and directories by the files
+ * within them, in name order.
+ * On success, "argc" and "argv" are replaced with an allocated vector
+ * to be freed with inputs_free().
+ * Return zero on failure, non-zero on success.
+ */
+int
+inputs_expand(int *argc, char ***argv)
+{
+	struct inputs	 in;
+	int		 i, rc = 1;
+
+	memset(&in, 0, sizeof(struct inputs));
+
+	for (i = 0; rc && i < *argc; i++)
+		if ((*argv)[i][0] == '@' && (*argv)[i][1] != '\0')
+			rc = inputs_list(&in, (*argv)[i] + 1);
+		else
+			rc = inputs_file(&in, (*argv)[i]);
+
+	if (rc && in.filesz > INT_MAX) {
+		ctxwarnx("too many input files");
+		rc = 0;
+	}
+	if (!rc) {
+		while (in.filesz > 0)
+			free(in.files[--in.filesz]);
+		free(in.files);
+		return 0;
+	}
+
+	if (in.files == NULL)
+		in.files = xcalloc(1, sizeof(char *));
+	*argc = in.filesz;
+	*argv = in.files;
+	return 1;
+}
+
+void
+inputs_free(int argc, char **argv)
+{
+	int	 i;
+
+	for (i = 0; i < argc; i++)
+		free(argv[i]);
+	free(argv);
+}
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Work shared between the threads of jobs_run().
+ */
+struct	jobq {
+	pthread_mutex_t	 mtx; /* protects all below */
+	size_t		 next; /* next item to run */
+	size_t		 n; /* number of items */
+	int		 rc; /* zero if any item failed */
+	jobfn		 fn; /* function to run */
+	void		*arg; /* argument to fn */
+};
+
+/*
+ * A worker thread and the jobserver token that allowed it.
+ */
+struct	jobw {
+	pthread_t	 thr;
+	struct jobq	*q;
+	size_t		 id; /* worker number (from one) */
+	char		 tok; /* jobserver token */
+};
+
+/*
+ * Items written by jobs_print().
+ * Each chunk of items is written into its own buffer.
+ */
+struct	jobout {
+	jobprintfn	  fn; /* function to write an item */
+	void		 *arg; /* argument to fn */
+	size_t		  lo; /* first item of first chunk */
+	size_t		  hi; /* last item (exclusive) */
+	char		**bufs; /* buffer per chunk */
+	size_t		 *bufsz; /* buffer sizes */
+};
+
+/*
+ * Items per chunk of jobs_print() and the number of chunks per worker
+ * that are buffered at once.
+ * A small number of big chunks amortises the cost of the buffers and
+ * hands-off; and keeping a bounded window bounds our memory.
+ */
+#define	JOBS_CHUNK	 64
+#define	JOBS_WINDOW	 4
+
+/*
+ * Limits on parallelism.
+ * If we're running under GNU make's jobserver ("jsrd" is not -1), each
+ * worker beyond our own implicit job needs a token.
+ * These are only set by jobs_init() from the command line, before any
+ * threads: library contexts never set them, so they run serially on
+ * their caller's thread (where their errors are reported) and never
+ * use the jobserver.
+ */
+static	size_t jobmax = 1; /* maximum workers */
+static	int jsrd = -1; /* jobserver read end or -1 */
+static	int jswr = -1; /* jobserver write end or -1 */
+static	int jsshared = 0; /* jsrd is make's blocking descriptor */
+static	int jsfifo = 0; /* jsrd and jswr opened from a FIFO */
+static	pthread_mutex_t jsmtx = PTHREAD_MUTEX_INITIALIZER; /* jsshared */
+
+/*
+ * Parse the descriptor pair "R,W" of the jobserver.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jobs_fds(const char *cp, size_t sz)
+{
+	char		 buf[32], *wp;
+	const char	*er;
+	int		 rd, wr;
+
+	if (sz >= sizeof(buf))
+		return 0;
+	memcpy(buf, cp, sz);
+	buf[sz] = '\0';
+	if ((wp = strchr(buf, ',')) == NULL)
+		return 0;
+	*wp++ = '\0';
+
+	rd = strtonum(buf, 0, INT_MAX, &er);
+	if (er != NULL)
+		return 0;
+	wr = strtonum(wp, 0, INT_MAX, &er);
+	if (er != NULL)
+		return 0;
+
+	/* Make doesn't pass descriptors to non-recursive commands. */
+
+	if (fcntl(rd, F_GETFD) == -1 || fcntl(wr, F_GETFD) == -1)
+		return 0;
+
+	/*
+	 * Reading from the shared (blocking) descriptor might block
+	 * indefinitely, so try to get our own non-blocking open file
+	 * description of the pipe.
+	 * Otherwise we'll need to make it non-blocking when reading.
+	 */
+
+	snprintf(buf, sizeof(buf), "/dev/fd/%d", rd);
+	if ((jsrd = open(buf, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) != -1 &&
+	    (fcntl(jsrd, F_GETFL) & O_NONBLOCK)) {
+		jswr = wr;
+		return 1;
+	}
+	if (jsrd != -1)
+		close(jsrd);
+
+	jsrd = rd;
+	jswr = wr;
+	jsshared = 1;
+	return 1;
+}
+
+/*
+ * Open the named jobserver FIFO.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+jobs_fifo(const char *cp, size_t sz)
+{
+	char	*path;
+
+	path = xstrndup(cp, sz);
+	jsrd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (jsrd != -1)
+		jswr = open(path, O_WRONLY | O_CLOEXEC);
+	if (jsrd == -1 || jswr == -1) {
+		ctxwarn("%s", path);
+		if (jsrd != -1)
+			close(jsrd);
+		jsrd = -1;
+	} else
+		jsfifo = 1;
+	free(path);
+	return jsrd != -1;
+}
+
+/*
+ * Look for GNU make's jobserver in MAKEFLAGS.
+ * This is either --jobserver-auth=fifo:PATH, --jobserver-auth=R,W, or
+ * the older --jobserver-fds=R,W.
+ * The last one wins, and variable assignments following "--" are not
+ * considered.
+ * Returns -1 if there's no jobserver, 0 if it's unusable, or 1.
+ */
+static int
+jobs_make(void)
+{
+	const char	*cp, *auth = NULL, *end;
+	size_t		 sz, authsz = 0;
+
+	if ((cp = getenv("MAKEFLAGS")) == NULL)
+		return -1;
+
+	while (*cp != '\0') {
+		while (*cp == ' ')
+			cp++;
+		if ((end = strchr(cp, ' ')) == NULL)
+			end = strchr(cp, '\0');
+		sz = end - cp;
+		if (sz == 2 && strncmp(cp, "--", 2) == 0)
+			break;
+		if (sz > 17 && strncmp(cp, "--jobserver-auth=", 17) == 0) {
+			auth = cp + 17;
+			authsz = sz - 17;
+		} else if (sz > 16 &&
+		    strncmp(cp, "--jobserver-fds=", 16) == 0) {
+			auth = cp + 16;
+			authsz = sz - 16;
+		}
+		cp = end;
+	}
+
+	if (auth == NULL)
+		return -1;
+	if (authsz > 5 && strncmp(auth, "fifo:", 5) == 0)
+		return jobs_fifo(auth + 5, authsz - 5);
+	return jobs_fds(auth, authsz);
+}
+
+/*
+ * Try to take a token from the jobserver without blocking.
+ * If we only have make's blocking descriptor, it's made non-blocking
+ * just for the read: polling first wouldn't do, as another of make's
+ * children may take the token between the poll and the read.
+ * Return zero if none is available, non-zero on success.
+ */
+static int
+jobs_take(char *tok)
+{
+	int	 fl, rc;
+
+	if (jsrd == -1)
+		return 1;
+	if (!jsshared)
+		return read(jsrd, tok, 1) == 1;
+
+	pthread_mutex_lock(&jsmtx);
+	if ((fl = fcntl(jsrd, F_GETFL)) == -1 ||
+	    fcntl(jsrd, F_SETFL, fl | O_NONBLOCK) == -1) {
+		pthread_mutex_unlock(&jsmtx);
+		return 0;
+	}
+	rc = read(jsrd, tok, 1) == 1;
+	fcntl(jsrd, F_SETFL, fl);
+	pthread_mutex_unlock(&jsmtx);
+	return rc;
+}
+
+/*
+ * Return a token taken with jobs_take().
+ */
+static void
+jobs_give(char tok)
+{
+	ssize_t	 ssz;
+
+	if (jswr == -1)
+		return;
+	while ((ssz = write(jswr, &tok, 1)) == -1 && errno == EINTR)
+		continue;
+	if (ssz != 1)
+		ctxwarn("jobserver");
+}
+
+/*
+ * Set up our parallelism.
+ * If "max" is zero, use the number of online processors.
+ * If run by GNU make with a jobserver, extra workers must take tokens
+ * from the jobserver; if the jobserver is advertised but unusable,
+ * don't run in parallel at all.
+ */
+void
+jobs_init(size_t max)
+{
+	long	 n;
+
+	if (max == 0) {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		max = n > 0 ? (size_t)n : 1;
+	}
+
+	jobmax = max;
+
+	if (jobmax > 1 && jobs_make() == 0)
+		jobmax = 1;
+}
+
+/*
+ * Close the jobserver descriptors opened by us.
+ */
+void
+jobs_free(void)
+{
+
+	if (jsrd != -1 && !jsshared)
+		close(jsrd);
+	if (jswr != -1 && jsfifo)
+		close(jswr);
+	jsrd = jswr = -1;
+	jsshared = jsfifo = 0;
+}
+
+/*
+ * Maximum number of workers passed to the function of jobs_run().
+ */
+size_t
+jobs_max(void)
+{
+
+	return jobmax;
+}
+
+/*
+ * Run items until none are left or one has failed.
+ */
+static void
+jobs_work(struct jobq *q, size_t id)
+{
+	size_t	 item;
+	int	 rc;
+
+	for (;;) {
+		pthread_mutex_lock(&q->mtx);
+		if (q->next == q->n || q->rc == 0) {
+			pthread_mutex_unlock(&q->mtx);
+			break;
+		}
+		item = q->next++;
+		pthread_mutex_unlock(&q->mtx);
+
+		rc = q->fn(q->arg, id, item);
+
+		if (!rc) {
+			pthread_mutex_lock(&q->mtx);
+			q->rc = 0;
+			pthread_mutex_unlock(&q->mtx);
+		}
+	}
+}
+
+static void *
+jobs_thread(void *arg)
+{
+	struct jobw	*w = arg;
+
+	jobs_work(w->q, w->id);
+	return NULL;
+}
+
+/*
+ * Run "fn" for each of the "n" items in no particular order.
+ * It's passed "arg", the worker number (less than jobs_max(), with the
+ * calling thread being zero), and the item number.
+ * Worker threads are only started when the jobserver (if any) allows.
+ * Items are no longer started once any has failed.
+ * Return zero if any item failed, non-zero on success.
+ */
+int
+jobs_run(size_t n, jobfn fn, void *arg)
+{
+	struct jobq	 q;
+	struct jobw	*w = NULL;
+	size_t		 i, wsz = 0, want;
+	int		 c;
+
+	memset(&q, 0, sizeof(struct jobq));
+	q.n = n;
+	q.rc = 1;
+	q.fn = fn;
+	q.arg = arg;
+
+	if ((c = pthread_mutex_init(&q.mtx, NULL)) != 0) {
+		ctxwarnc(c, "pthread_mutex_init");
+		return 0;
+	}
+
+	want = n < jobmax ? n : jobmax;
+
+	if (want > 1)
+		w = xcalloc(want - 1, sizeof(struct jobw));
+
+	for (i = 0; i + 1 < want; i++) {
+		w[i].q = &q;
+		w[i].id = i + 1;
+		if (!jobs_take(&w[i].tok))
+			break;
+		c = pthread_create(&w[i].thr, NULL, jobs_thread, &w[i]);
+		if (c != 0) {
+			ctxwarnc(c, "pthread_create");
+			jobs_give(w[i].tok);
+			break;
+		}
+		wsz++;
+	}
+
+	jobs_work(&q, 0);
+
+	for (i = 0; i < wsz; i++) {
+		if ((c = pthread_join(w[i].thr, NULL)) != 0) {
+			ctxwarnc(c, "pthread_join");
+			q.rc = 0;
+			continue;
+		}
+		jobs_give(w[i].tok);
+	}
+
+	free(w);
+	pthread_mutex_destroy(&q.mtx);
+	return q.rc;
+}
+
+static int
+jobs_outjob(void *dat, size_t worker, size_t item)
+{
+	struct jobout	*o = dat;
+	FILE		*f;
+	size_t		 i, end;
+
+	i = o->lo + item * JOBS_CHUNK;
+	end = i + JOBS_CHUNK < o->hi ? i + JOBS_CHUNK : o->hi;
+
+	if ((f = open_memstream(&o->bufs[item], &o->bufsz[item])) == NULL) {
+		ctxwarn("open_memstream");
+		return 0;
+	}
+	for ( ; i < end; i++)
+		o->fn(f, o->arg, i);
+	if (fclose(f) == EOF) {
+		ctxwarn("open_memstream");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Write items [lo, hi) to "f" in order using "fn", which is passed the
+ * output stream, "arg", and the item.
+ * With more than one worker, chunks of items are written into memory
+ * in parallel, then copied into "f" in order.
+ * Return zero on failure, non-zero on success.
+ */
+int
+jobs_print(FILE *f, size_t lo, size_t hi, jobprintfn fn, void *arg)
+{
+	struct jobout	 o;
+	size_t		 i, n, win, chunks;
+	int		 rc = 1;
+
+	if (jobmax == 1 || hi - lo <= JOBS_CHUNK) {
+		for (i = lo; i < hi; i++)
+			fn(f, arg, i);
+		return 1;
+	}
+
+	win = jobmax * JOBS_WINDOW;
+
+	memset(&o, 0, sizeof(struct jobout));
+	o.fn = fn;
+	o.arg = arg;
+	o.bufs = xcalloc(win, sizeof(char *));
+	o.bufsz = xcalloc(win, sizeof(size_t));
+
+	for (o.lo = lo; rc && o.lo < hi; o.lo = o.hi) {
+		n = hi - o.lo;
+		if (n > win * JOBS_CHUNK)
+			n = win * JOBS_CHUNK;
+		o.hi = o.lo + n;
+		chunks = (n + JOBS_CHUNK - 1) / JOBS_CHUNK;
+
+		rc = jobs_run(chunks, jobs_outjob, &o);
+
+		for (i = 0; i < chunks; i++) {
+			if (rc && o.bufsz[i] > 0)
+				fwrite(o.bufs[i], o.bufsz[i], 1, f);
+			free(o.bufs[i]);
+			o.bufs[i] = NULL;
+			o.bufsz[i] = 0;
+		}
+	}
+
+	free(o.bufs);
+	free(o.bufsz);
+	return rc;
+}
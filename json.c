@@ -32,6 +32,36 @@
 #include "extern.h"
 #include "version.h"
 
+/*
+ * Fields that may be selected for output (-f).
+ * Names are those of the article properties in schema.json, with
+ * markup properties optionally having the member appended.
+ */
+static	const struct jsonfield {
+	const char	*name;
+	unsigned int	 fields; /* JSON_xxx */
+} jsonfields[] = {
+	{ "src",		JSON_SRC },
+	{ "base",		JSON_BASE },
+	{ "stripbase",		JSON_STRIPBASE },
+	{ "striplangbase",	JSON_STRIPLANGBASE },
+	{ "time",		JSON_TIME },
+	{ "title",		JSON_TITLE_TEXT | JSON_TITLE_XML },
+	{ "title.text",		JSON_TITLE_TEXT },
+	{ "title.xml",		JSON_TITLE_XML },
+	{ "aside",		JSON_ASIDE_TEXT | JSON_ASIDE_XML },
+	{ "aside.text",		JSON_ASIDE_TEXT },
+	{ "aside.xml",		JSON_ASIDE_XML },
+	{ "author",		JSON_AUTHOR_TEXT | JSON_AUTHOR_XML },
+	{ "author.text",	JSON_AUTHOR_TEXT },
+	{ "author.xml",		JSON_AUTHOR_XML },
+	{ "article",		JSON_ARTICLE },
+	{ "article.xml",	JSON_ARTICLE },
+	{ "tags",		JSON_TAGS },
+	{ "keys",		JSON_KEYS },
+	{ NULL,			0 }
+};
+
 /*
  * FIXME: use strcspn().
  */
@@ -89,23 +119,31 @@ json_text(const char *key, const char *text, FILE *f)
 	json_quoted(text, f);
 }
 
+/*
+ * Print the markup "text" and "xml" if selected, or nothing if neither
+ * is selected.
+ * The text may be NULL, in which case it is never printed.
+ */
 static void
-json_textxml(const char *key, 
-	const char *text, const char *xml, FILE *f)
+json_textxml(const char *key, const char *text, const char *xml,
+	int dotext, int doxml, FILE *f)
 {
 
 	json_quoted(key, f);
 	fputc(':', f);
 	fputc('{', f);
-	if (text != NULL) {
+	if (text != NULL && dotext) {
 		json_quoted("text", f);
 		fputc(':', f);
 		json_quoted(text, f);
-		fputc(',', f);
+		if (doxml)
+			fputc(',', f);
+	}
+	if (doxml) {
+		json_quoted("xml", f);
+		fputc(':', f);
+		json_quoted(xml, f);
 	}
-	json_quoted("xml", f);
-	fputc(':', f);
-	json_quoted(xml, f);
 	fputc('}', f);
 }
 
@@ -141,82 +179,237 @@ json_textlist(const char *key, char **tags, size_t tagsz, FILE *f,
 	}
 }
 
+/*
+ * Parse the comma-separated list of field names "arg" into "fields".
+ * Return zero on failure (unknown field), non-zero on success.
+ */
+int
+json_fields(const char *arg, unsigned int *fields)
+{
+	const char	*cp, *end;
+	size_t		 i, sz;
+
+	for (*fields = 0, cp = arg; ; cp = end + 1) {
+		if ((end = strchr(cp, ',')) == NULL)
+			end = strchr(cp, '\0');
+		sz = end - cp;
+		for (i = 0; jsonfields[i].name != NULL; i++)
+			if (strlen(jsonfields[i].name) == sz &&
+			    strncmp(jsonfields[i].name, cp, sz) == 0)
+				break;
+		if (jsonfields[i].name == NULL) {
+			ctxwarnx("%.*s: unknown JSON field", (int)sz, cp);
+			return 0;
+		}
+		*fields |= jsonfields[i].fields;
+		if (*end == '\0')
+			break;
+	}
+	return 1;
+}
+
+/*
+ * Articles written by json_article().
+ */
+struct	jsonout {
+	const struct article *sargs; /* sorted articles */
+	size_t		 lo; /* first article */
+	size_t		 hi; /* last article (exclusive) */
+	unsigned int	 fields; /* JSON_xxx to output */
+	size_t		 split; /* articles per shard or zero */
+	int		 ndjson; /* one article per line */
+	int		 ndhead; /* ...after a version line */
+	FILE		*out; /* output instead of a file or NULL */
+};
+
+/*
+ * Format a single article's selected fields and its trailing comma, if
+ * not the last, or newline if newline-delimited.
+ */
+static void
+json_article(FILE *f, void *arg, size_t j)
+{
+	const struct jsonout *o = arg;
+	const struct article *a = &o->sargs[j];
+	unsigned int	 fl = o->fields;
+	int		 first = 1;
+
+#define	FIELD(_fl) \
+	((fl & (_fl)) && (first ? (first = 0, 1) : (fputc(',', f), 1)))
+
+	fputc('{', f);
+	if (FIELD(JSON_SRC))
+		json_text("src", a->src, f);
+	if (FIELD(JSON_BASE))
+		json_text("base", a->base, f);
+	if (FIELD(JSON_STRIPBASE))
+		json_text("stripbase", a->stripbase, f);
+	if (FIELD(JSON_STRIPLANGBASE))
+		json_text("striplangbase", a->striplangbase, f);
+	if (FIELD(JSON_TIME))
+		json_time("time", a->time, f);
+	if (FIELD(JSON_TITLE_TEXT | JSON_TITLE_XML))
+		json_textxml("title", a->titletext, a->title,
+			fl & JSON_TITLE_TEXT, fl & JSON_TITLE_XML, f);
+	if (FIELD(JSON_ASIDE_TEXT | JSON_ASIDE_XML))
+		json_textxml("aside", a->asidetext, a->aside,
+			fl & JSON_ASIDE_TEXT, fl & JSON_ASIDE_XML, f);
+	if (FIELD(JSON_AUTHOR_TEXT | JSON_AUTHOR_XML))
+		json_textxml("author", a->authortext, a->author,
+			fl & JSON_AUTHOR_TEXT, fl & JSON_AUTHOR_XML, f);
+	if (FIELD(JSON_ARTICLE))
+		json_textxml("article", NULL, a->article, 0, 1, f);
+	if (FIELD(JSON_TAGS))
+		json_textlist("tags", a->tagmap, a->tagmapsz, f, 0);
+	if (FIELD(JSON_KEYS))
+		json_textlist("keys", a->setmap, a->setmapsz, f, 1);
+	fputc('}', f);
+	if (o->ndjson)
+		fputc('\n', f);
+	else if (j < o->hi - 1)
+		fputc(',', f);
+
+#undef	FIELD
+}
+
+/*
+ * Format an article's entry in the index of a split export, which has
+ * only what's needed to list articles and the shard holding the rest.
+ */
+static void
+json_index(FILE *f, void *arg, size_t j)
+{
+	const struct jsonout *o = arg;
+	const struct article *a = &o->sargs[j];
+
+	fputc('{', f);
+	json_text("src", a->src, f);
+	fputc(',', f);
+	json_time("time", a->time, f);
+	fputc(',', f);
+	json_textxml("title", a->titletext, a->title, 1, 0, f);
+	fputc(',', f);
+	json_textlist("tags", a->tagmap, a->tagmapsz, f, 0);
+	fprintf(f, ",\"shard\":%zu}", (j - o->lo) / o->split);
+	if (j < o->hi - 1)
+		fputc(',', f);
+}
+
+/*
+ * Write a JSON document to "dst" of articles [lo, hi) formatted by
+ * "fn".
+ * If "split" is non-zero, this is an index and is prefixed by the
+ * size and count of shards.
+ * If newline-delimited, each article is on its own line, optionally
+ * after a line having only the version.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+json_write(const char *dst, struct jsonout *o,
+	size_t lo, size_t hi, jobprintfn fn)
+{
+	FILE	*f = stdout;
+	int	 rc;
+
+	if (o->out != NULL)
+		f = o->out;
+	else if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
+		ctxwarn("%s", dst);
+		return 0;
+	}
+
+	if (o->ndjson) {
+		if (o->ndhead) {
+			fputc('{', f);
+			json_text("version", VERSION, f);
+			fputs("}\n", f);
+		}
+		o->hi = hi;
+		rc = jobs_print(f, lo, hi, fn, o);
+		goto out;
+	}
+	fputc('{', f);
+	json_text("version", VERSION, f);
+	fputc(',', f);
+	if (fn == json_index)
+		fprintf(f, "\"shardsize\":%zu,\"shards\":%zu,",
+			o->split, (hi - lo + o->split - 1) / o->split);
+	json_quoted("articles", f);
+	fputs(": [", f);
+
+	o->hi = hi;
+	if ((rc = jobs_print(f, lo, hi, fn, o)))
+		fputs("]}\n", f);
+out:
+	if (f != stdout && f != o->out && fclose(f) == EOF) {
+		ctxwarn("%s", dst);
+		rc = 0;
+	}
+	return rc;
+}
+
 /*
  * Format entire articles into JSON output.
+ * Only the JSON_xxx fields of "opts" are written.
+ * If "opts" has a split, "dst" is an index of all articles and the
+ * articles themselves are written in order into files of that many
+ * articles each, named as "dst" (less any .json suffix) followed by
+ * the shard number (from zero) and .json.
+ * Articles are formatted in parallel, if possible.
  * I still don't have the schema really documented except in the
  * manpage, so this should probably receive more attention to make it
  * more in-line with JSON expectations.
  */
 int
-json(XML_Parser p, int sz, char *src[], const char *dst, enum asort asort)
+json(XML_Parser p, const struct input *in, int sz, char *src[],
+	const char *dst, enum asort asort, const struct jsonopts *opts)
 {
-	size_t		 j, sargsz = 0;
-	int		 i, rc = 0;
-	FILE		*f = stdout;
+	char		*fn = NULL;
+	const char	*base = "blog";
+	size_t		 sargsz = 0, lo, hi, i, basesz, split;
+	int		 rc = 0;
 	struct article	*sargs = NULL;
+	struct jsonout	 o;
 
-	for (i = 0; i < sz; i++)
-		if (!sblg_parse(p, src[i], &sargs, &sargsz, NULL))
-			goto out;
+	if (!corpus_load(p, in, sz, src, NULL, 
+	    asort, &sargs, &sargsz, &lo, &hi))
+		goto out;
 
-	sblg_sort(sargs, sargsz, asort);
+	memset(&o, 0, sizeof(struct jsonout));
+	o.sargs = sargs;
+	o.fields = opts->fields;
+	o.lo = lo;
+	o.split = split = opts->split;
+	o.ndjson = opts->ndjson;
+	o.ndhead = opts->ndhead;
+	o.out = in->out;
 
-	if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
-		warn("%s", dst);
+	if (split == 0) {
+		rc = json_write(dst, &o, lo, hi, json_article);
 		goto out;
 	}
 
-	fputc('{', f);
-	json_text("version", VERSION, f);
-	fputc(',', f);
-	json_quoted("articles", f);
-	fputs(": [", f);
+	if (!json_write(dst, &o, lo, hi, json_index))
+		goto out;
 
-	for (j = 0; j < sargsz; j++) {
-		fputc('{', f);
-		json_text("src", sargs[j].src, f);
-		fputc(',', f);
-		json_text("base", sargs[j].base, f);
-		fputc(',', f);
-		json_text("stripbase", 
-			sargs[j].stripbase, f);
-		fputc(',', f);
-		json_text("striplangbase", 
-			sargs[j].striplangbase, f);
-		fputc(',', f);
-		json_time("time", sargs[j].time, f);
-		fputc(',', f);
-		json_textxml("title", 
-			sargs[j].titletext, 
-			sargs[j].title, f);
-		fputc(',', f);
-		json_textxml("aside", 
-			sargs[j].asidetext, 
-			sargs[j].aside, f);
-		fputc(',', f);
-		json_textxml("author", 
-			sargs[j].authortext, 
-			sargs[j].author, f);
-		fputc(',', f);
-		json_textxml("article", NULL,
-			sargs[j].article, f);
-		fputc(',', f);
-		json_textlist("tags", sargs[j].tagmap, 
-			sargs[j].tagmapsz, f, 0);
-		fputc(',', f);
-		json_textlist("keys", sargs[j].setmap,
-			sargs[j].setmapsz, f, 1);
-		fputc('}', f);
-		if (j < sargsz - 1)
-			fputc(',', f);
+	if (strcmp(dst, "-"))
+		base = dst;
+	basesz = strlen(base);
+	if (basesz > 5 && strcmp(base + basesz - 5, ".json") == 0)
+		basesz -= 5;
+
+	for (i = lo; i < hi; i += split) {
+		free(fn);
+		xasprintf(&fn, "%.*s.%zu.json", 
+			(int)basesz, base, (i - lo) / split);
+		if (!json_write(fn, &o, i, 
+		    i + split < hi ? i + split : hi, json_article))
+			goto out;
 	}
-	fputs("]}\n", f);
 
 	rc = 1;
 out:
+	free(fn);
 	sblg_free(sargs, sargsz);
-	if (f != NULL && f != stdout)
-		fclose(f);
 	return rc;
 }
-
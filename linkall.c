@@ -65,6 +65,9 @@ struct	linkall {
 	size_t		  spos; /* current sarg being shown */ 
 	size_t		  sposz; /* size of sargs */
 	size_t		  ssposz;  /* number of sargs to show */
+	struct tagtab	  tags; /* numbered tags of sargs */
+	size_t		 *tagids; /* tag numbers of all sargs */
+	size_t		 *tagoff; /* range of each sarg in tagids */
 	size_t		  stack; /* temporary: tag stack size */
 	char		 *stacktag; /* tag starting nav/article or NULL */
 	size_t		  navstart; /* temporary: nav items to show */
@@ -164,23 +167,40 @@ nav_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 }
 
 /*
- * Find at least one of the given "tags" in "tagmap".
- * If "tags" is NULL or the tag was found, return 1.
- * If "tagmap" is empty or the tag wasn't found, return 0.
+ * Resolve the "tags" of size "tagsz" to tag numbers in "ids", which
+ * must be at least as large, dropping tags not on any article.
+ * Returns the number of tag numbers.
+ */
+static size_t
+tagresolve(const struct linkall *arg, char **tags, size_t tagsz,
+	size_t *ids)
+{
+	size_t	 i, idsz;
+
+	for (i = idsz = 0; i < tagsz; i++)
+		if (tagtab_find(&arg->tags, tags[i], &ids[idsz]))
+			idsz++;
+	return idsz;
+}
+
+/*
+ * Find at least one of the tag numbers "ids" in those of the article
+ * "art", which is its index before any navigation sort.
+ * If "tagsz", the number of tags requested, is zero, return 1.
+ * If the article has no tags or the tag wasn't found, return 0.
  */
 static int
-tagfind(char **tags, size_t tagsz, char **tagmap, size_t tagmapsz)
+tagfind(const struct linkall *arg, size_t tagsz,
+	const size_t *ids, size_t idsz, size_t art)
 {
-	size_t	 	 i, j;
+	size_t	 i, j;
 
 	if (tagsz == 0)
 		return 1;
-	if (tagmapsz == 0) 
-		return 0;
 
-	for (i = 0; i < tagsz; i++) 
-		for (j = 0; j < tagmapsz; j++)
-			if (0 == strcmp(tags[i], tagmap[j]))
+	for (i = arg->tagoff[art]; i < arg->tagoff[art + 1]; i++)
+		for (j = 0; j < idsz; j++)
+			if (arg->tagids[i] == ids[j])
 				return 1;
 
 	return 0;
@@ -195,10 +215,11 @@ static void
 nav_end(void *dat, const XML_Char *s)
 {
 	struct linkall	*arg = dat;
-	size_t		 i, k, count, setsz;
+	size_t		 i, k, count, setsz, idsz, *ids, *perm = NULL;
 	char		 buf[32]; 
 	int		 rc;
 	struct article	*sv = NULL;
+	struct tm	 tm;
 
 	assert(arg->stacktag != NULL);
 	if (strcmp(s, arg->stacktag) != 0 || --arg->stack != 0) {
@@ -211,13 +232,27 @@ nav_end(void *dat, const XML_Char *s)
 	arg->textmode = TEXT_TMPL;
 	XML_SetElementHandler(arg->p, tmpl_begin, tmpl_end);
 
+	/*
+	 * If sorting, only the order is computed: tags are looked up by
+	 * each article's original index in "perm".
+	 */
+
 	if (arg->usesort) {
 		sv = arg->sargs;
-		arg->sargs = calloc(arg->sposz, sizeof(struct article));
-		memcpy(arg->sargs, sv, arg->sposz * sizeof(struct article));
-		sblg_sort(arg->sargs, arg->sposz, arg->navsort);
+		perm = xcalloc(arg->sposz + 1, sizeof(size_t));
+		article_sort_index(sv, arg->sposz, arg->navsort, perm);
+		arg->sargs = xcalloc(arg->sposz + 1, sizeof(struct article));
+		for (i = 0; i < arg->sposz; i++)
+			arg->sargs[i] = sv[perm[i]];
 	}
 
+	ids = xcalloc(arg->navtagsz + 1, sizeof(size_t));
+	idsz = tagresolve(arg, arg->navtags, arg->navtagsz, ids);
+
+#define	NAVFIND(_k) \
+	tagfind(arg, arg->navtagsz, ids, idsz, \
+		perm == NULL ? (_k) : perm[(_k)])
+
 	/*
 	 * Advance until "k" is at the article we want to start
 	 * printing.
@@ -226,16 +261,14 @@ nav_end(void *dat, const XML_Char *s)
 	 */
 
 	for (i = k = 0; i < arg->navstart && k < arg->sposz; k++) {
-		rc = tagfind(arg->navtags, arg->navtagsz, 
-			arg->sargs[k].tagmap, arg->sargs[k].tagmapsz);
+		rc = NAVFIND(k);
 		i += (rc != 0);
 	}
 
 	/* Count total number of remaining articles. */
 
 	for (i = k, setsz = count = 0; i < arg->sposz; i++) {
-		rc = tagfind(arg->navtags, arg->navtagsz, 
-			arg->sargs[i].tagmap, arg->sargs[i].tagmapsz);
+		rc = NAVFIND(i);
 		if (rc == 0)
 			continue;
 		if (count < arg->navlen)
@@ -251,8 +284,7 @@ nav_end(void *dat, const XML_Char *s)
 	 */
 
 	for (i = 0; k < arg->sposz; k++) {
-		rc = tagfind(arg->navtags, arg->navtagsz, 
-			arg->sargs[k].tagmap, arg->sargs[k].tagmapsz);
+		rc = NAVFIND(k);
 		if (rc == 0)
 			continue;
 
@@ -265,7 +297,7 @@ nav_end(void *dat, const XML_Char *s)
 		if (arg->navformat == NAVFORMAT_LIST_SUMMARISE ||
 		    arg->navformat == NAVFORMAT_SUMMARISE) {
 			(void)strftime(buf, sizeof(buf), "%Y-%m-%d", 
-				gmtime(&arg->sargs[k].time));
+				gmtime_r(&arg->sargs[k].time, &tm));
 			fputs(buf, arg->f);
 			fputs(": ", arg->f);
 			xmlopen(arg->f, "a", "href", 
@@ -307,6 +339,10 @@ nav_end(void *dat, const XML_Char *s)
 	arg->navtags = NULL;
 	arg->navtagsz = 0;
 
+#undef	NAVFIND
+
+	free(ids);
+	free(perm);
 	if (sv != NULL) {
 		free(arg->sargs);
 		arg->sargs = sv;
@@ -335,7 +371,7 @@ tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 	const XML_Char	**attp;
 	const XML_Char	 *sort = NULL;
 	char		**tags = NULL;
-	size_t		  i, tagsz = 0;
+	size_t		  i, tagsz = 0, idsz, *ids;
 	int		  start_nav = 0, start_article = 0;
 
 	assert(arg->stack == 0);
@@ -503,11 +539,12 @@ tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
 
 		/* Look for the next article mathing the given tag. */
 
+		ids = xcalloc(tagsz + 1, sizeof(size_t));
+		idsz = tagresolve(arg, tags, tagsz, ids);
 		for ( ; arg->spos < arg->ssposz; arg->spos++)
-			if (tagfind(tags, tagsz, 
-			    arg->sargs[arg->spos].tagmap,
-			    arg->sargs[arg->spos].tagmapsz))
+			if (tagfind(arg, tagsz, ids, idsz, arg->spos))
 				break;
+		free(ids);
 
 		for (i = 0; i < tagsz; i++)
 			free(tags[i]);
@@ -573,12 +610,13 @@ tmpl_begin(void *dat, const XML_Char *s, const XML_Char **atts)
  * Return zero on fatal error, non-zero on success.
  */
 int
-linkall(XML_Parser p, const char *templ, const char *force, int sz,
-    char *src[], const char *dst, enum asort asort)
+linkall(XML_Parser p, const char *templ, const char *force,
+    const struct input *in, int sz, char *src[], const char *dst,
+    enum asort asort)
 {
 	char		*buf = NULL;
-	size_t		 j, ssz = 0;
-	int		 i, fd = -1, rc = 0;
+	size_t		 j, ssz = 0, lo, hi;
+	int		 fd = -1, rc = 0;
 	FILE		*f = stdout;
 	struct linkall	 arg;
 	struct article	*sargs = NULL;
@@ -588,16 +626,16 @@ linkall(XML_Parser p, const char *templ, const char *force, int sz,
 
 	/* Grok all article data and sort by date. */
 
-	for (i = 0; i < sz; i++)
-		if (!sblg_parse(p, src[i], &sargs, &sargsz, NULL))
-			goto out;
-
-	sblg_sort(sargs, sargsz, asort);
+	if (!corpus_load(p, in, sz, src, NULL, 
+	    asort, &sargs, &sargsz, &lo, &hi))
+		goto out;
 
 	/* Open a FILE to the output file or stream. */
 
-	if (strcmp(dst, "-") && ((f = fopen(dst, "w"))) == NULL) {
-		warn("%s", dst);
+	if (in->out != NULL)
+		f = in->out;
+	else if (strcmp(dst, "-") && ((f = fopen(dst, "w"))) == NULL) {
+		ctxwarn("%s", dst);
 		goto out;
 	} 
 	
@@ -614,9 +652,10 @@ linkall(XML_Parser p, const char *templ, const char *force, int sz,
 
 	arg.sargs = sargs;
 	arg.sposz = arg.ssposz = sargsz;
+	tagtab_ids(&arg.tags, sargs, sargsz, &arg.tagids, &arg.tagoff);
 	arg.p = p;
 	arg.src = templ;
-	arg.dst = strcmp(dst, "-") ? dst : NULL;
+	arg.dst = strcmp(dst, "-") && in->out == NULL ? dst : NULL;
 	arg.f = f;
 	arg.single = -1;
 	arg.textmode = TEXT_TMPL;
@@ -631,7 +670,7 @@ linkall(XML_Parser p, const char *templ, const char *force, int sz,
 			arg.spos = j;
 			arg.ssposz = j + 1;
 		} else {
-			warnx("%s: not in input list", force);
+			ctxwarnx("%s: not in input list", force);
 			goto out;
 		}
 	}
@@ -646,7 +685,7 @@ linkall(XML_Parser p, const char *templ, const char *force, int sz,
 	XML_UseForeignDTD(p, XML_TRUE);
 
 	if (XML_Parse(p, buf, (int)ssz, 1) != XML_STATUS_OK) {
-		warnx("%s:%zu:%zu: %s", templ, 
+		ctxwarnx("%s:%zu:%zu: %s", templ, 
 			XML_GetCurrentLineNumber(p),
 			XML_GetCurrentColumnNumber(p),
 			XML_ErrorString(XML_GetErrorCode(p)));
@@ -658,13 +697,16 @@ linkall(XML_Parser p, const char *templ, const char *force, int sz,
 out:
 	sblg_free(sargs, sargsz);
 	mmap_close(fd, buf, ssz);
-	if (f != NULL && f != stdout)
+	if (f != NULL && f != stdout && f != in->out)
 		fclose(f);
 	for (j = 0; j < arg.navtagsz; j++)
 		free(arg.navtags[j]);
 	free(arg.navtags);
 	free(arg.nav);
 	free(arg.buf);
+	free(arg.tagids);
+	free(arg.tagoff);
+	tagtab_free(&arg.tags);
 	return rc;
 }
 
@@ -675,60 +717,53 @@ out:
  * Return zero on fatal error, non-zero on success.
  */
 int
-linkall_r(XML_Parser p, const char *templ, int sz, char *src[],
-    enum asort asort)
+linkall_r(XML_Parser p, const char *templ, const struct input *in,
+    int sz, char *src[], enum asort asort)
 {
 	char		*buf = NULL, *dst = NULL;
-	size_t		 j, ssz = 0, wsz;
-	int		 i, fd = -1, rc = 0;
+	size_t		 j, ssz = 0, lo, hi;
+	int		 fd = -1, rc = 0;
 	FILE		*f = NULL;
 	struct linkall	 arg;
 	struct article	*sargs = NULL;
 	size_t		 sargsz = 0;
-	const char	*cp;
 
 	memset(&arg, 0, sizeof(struct linkall));
 
 	/* 
 	 * Grok all article data then sort.
 	 * Ignore cmdline sort order: it's already like that.
+	 * Only the articles in our shard are output.
 	 */
 
-	for (i = 0; i < sz; i++)
-		if (!sblg_parse(p, src[i], &sargs, &sargsz, NULL))
-			goto out;
-
-	sblg_sort(sargs, sargsz, asort);
+	if (!corpus_load(p, in, sz, src, NULL, 
+	    asort, &sargs, &sargsz, &lo, &hi))
+		goto out;
 
 	/* Map the template into memory for parsing. */
 
 	if (!mmap_open(templ, &fd, &buf, &ssz))
 		goto out;
 
+	tagtab_ids(&arg.tags, sargs, sargsz, &arg.tagids, &arg.tagoff);
+
 	/*
 	 * Iterate through each input article.
 	 * Replace its filename with HTML and use that as the output.
 	 */
 
-	for (j = 0; j < sargsz; j++) {
-		wsz = strlen(sargs[j].src);
-		if ((cp = strrchr(sargs[j].src, '.')) == NULL || 
-		    strcasecmp(cp + 1, "xml")) {
-			/* Append .html to input name. */
-			dst = xmalloc(wsz + 6);
-			strlcpy(dst, sargs[j].src, wsz + 6);
-			strlcat(dst, ".html", wsz + 6);
-		} else {
-			/* Replace .xml with .html. */
-			dst = xmalloc(wsz + 2);
-			strlcpy(dst, sargs[j].src, wsz - 2);
-			strlcat(dst, "html", wsz + 2);
-		} 
+	for (j = lo; j < hi; j++) {
+		if (strcmp(sargs[j].src, "-") == 0) {
+			ctxwarnx("-: standard input has no output "
+				"name: set data-sblg-source");
+			goto out;
+		}
+		dst = html_name(sargs[j].src);
 
 		/* Open the output filename. */
 		
 		if ((f = fopen(dst, "w")) == NULL) {
-			warn("%s", dst);
+			ctxwarn("%s", dst);
 			goto out;
 		} 
 
@@ -754,7 +789,7 @@ linkall_r(XML_Parser p, const char *templ, int sz, char *src[],
 		XML_UseForeignDTD(p, XML_TRUE);
 
 		if (XML_Parse(p, buf, (int)ssz, 1) != XML_STATUS_OK) {
-			warnx("%s:%zu:%zu: %s", templ, 
+			ctxwarnx("%s:%zu:%zu: %s", templ, 
 				XML_GetCurrentLineNumber(p),
 				XML_GetCurrentColumnNumber(p),
 				XML_ErrorString(XML_GetErrorCode(p)));
@@ -779,6 +814,9 @@ out:
 	free(arg.navtags);
 	free(arg.nav);
 	free(arg.buf);
+	free(arg.tagids);
+	free(arg.tagoff);
+	tagtab_free(&arg.tags);
 	free(arg.stacktag);
 	free(dst);
 	return rc;
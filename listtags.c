@@ -16,38 +16,29 @@
  */
 #include "config.h"
 
-#if HAVE_SYS_QUEUE
-# include <sys/queue.h>
-#endif
-
 #include <assert.h>
 #include <ctype.h>
 #if HAVE_ERR
 # include <err.h>
 #endif
 #include <expat.h>
-#include <search.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "extern.h"
 
-struct	filen {
-	const char	  *fn; /* name of file */
-	TAILQ_ENTRY(filen) entries;
-};
-
-TAILQ_HEAD(filenq, filen);
-
+/*
+ * A tag and the articles referencing it.
+ * Articles are a range of the posting array, in article order.
+ * These are indexed by tag number.
+ */
 struct	tagn {
-	struct filenq	 *fq; /* files referencing tag */
-	char	 	 *tag; /* name of tag */
-	TAILQ_ENTRY(tagn) entries;
+	const char	*tag; /* name of tag */
+	size_t		 count; /* articles referencing tag */
+	size_t		 post; /* offset in posting array */
 };
 
-TAILQ_HEAD(tagnq, tagn);
-
 /*
  * Strip escaped white-space.
  * XXX: should we do any escaping here?
@@ -61,83 +52,110 @@ unescape(const char *cp)
 			putchar(*cp);
 }
 
+static int
+tagcmp_name(const void *p1, const void *p2)
+{
+	const struct tagn *t1 = p1, *t2 = p2;
+
+	return strcmp(t1->tag, t2->tag);
+}
+
+static int
+tagcmp_count(const void *p1, const void *p2)
+{
+	const struct tagn *t1 = p1, *t2 = p2;
+
+	if (t1->count != t2->count)
+		return t1->count < t2->count ? 1 : -1;
+	return strcmp(t1->tag, t2->tag);
+}
+
 /*
  * Print tags in tag-major ordering.
- * This will print the articles referencing individual tags.
+ * This will print the articles referencing individual tags, or only
+ * the number of articles if "counts" is specified.
  * This is more complicated because our data comes in article-major
  * ordering so we need to hash entries and bucket.
  */
 static void
-dorlist(const struct article *sargs, size_t sargsz, int json, int lf)
+dorlist(const struct article *sargs, size_t sargsz, int json, int lf,
+	enum tagorder order, int counts)
 {
-	size_t	 	 i, j;
-	char		*copy;
-	ENTRY		 e;
-	ENTRY		*ep;
-	struct filenq	*fq;
-	struct filen	*fn;
-	struct tagnq	 tq;
-	struct tagn	*tn;
+	size_t	 	  i, j, k, *ids, *off, *fill, tagsz;
+	const char	**posts;
+	struct tagtab	  tab;
+	struct tagn	 *tags, *tn;
 
-	TAILQ_INIT(&tq);
+	memset(&tab, 0, sizeof(struct tagtab));
 
 	/*
-	 * Start by creating a table of all tags and the files that
-	 * reference those tags.
-	 * Use the shitty hcreate() interface.
+	 * Start by numbering all tags, then count the files that
+	 * reference them.
 	 */
 
-	if (!hcreate(256))
-		errx(EXIT_FAILURE, "hcreate");
+	tagtab_ids(&tab, sargs, sargsz, &ids, &off);
+	tagsz = tab.tagsz;
+	tags = xcalloc(tagsz + 1, sizeof(struct tagn));
 
-	for (i = 0; i < sargsz; i++) {
-		for (j = 0; j < sargs[i].tagmapsz; j++) {
-			e.key = sargs[i].tagmap[j];
-			e.data = NULL;
-			if ((ep = hsearch(e, FIND)) == NULL) {
-				fq = xmalloc(sizeof(struct filenq));
-				TAILQ_INIT(fq);
-				e.data = (char *)fq;
-				copy = xstrdup(sargs[i].tagmap[j]);
-				e.key = copy;
-				if ((ep = hsearch(e, ENTER)) == NULL)
-					errx(EXIT_FAILURE, "hsearch");
-				tn = xmalloc(sizeof(struct tagn));
-				tn->tag = copy;
-				tn->fq = fq;
-				TAILQ_INSERT_TAIL(&tq, tn, entries);
-			}
-			fq = (struct filenq *)ep->data;
-			fn = xmalloc(sizeof(struct filen));
-			fn->fn = sargs[i].src;
-			TAILQ_INSERT_TAIL(fq, fn, entries);
-		}
+	for (i = 0; i < tagsz; i++)
+		tags[i].tag = tab.tags[i];
+	for (k = 0; k < off[sargsz]; k++)
+		tags[ids[k]].count++;
+
+	/* Lay out the files of each tag contiguously. */
+
+	for (k = i = 0; i < tagsz; i++) {
+		tags[i].post = k;
+		k += tags[i].count;
 	}
 
-	TAILQ_FOREACH(tn, &tq, entries) {
+	posts = xcalloc(off[sargsz] + 1, sizeof(char *));
+	fill = xcalloc(tagsz + 1, sizeof(size_t));
+
+	for (i = 0; i < sargsz; i++)
+		for (k = off[i]; k < off[i + 1]; k++)
+			posts[tags[ids[k]].post + 
+			      fill[ids[k]]++] = sargs[i].src;
+
+	if (order == TAGORDER_NAME)
+		qsort(tags, tagsz, sizeof(struct tagn), tagcmp_name);
+	else if (order == TAGORDER_COUNT)
+		qsort(tags, tagsz, sizeof(struct tagn), tagcmp_count);
+
+	for (i = 0; i < tagsz; i++) {
+		tn = &tags[i];
 		if (json) {
 			printf("{\"tag\": \"");
 			unescape(tn->tag);
-			printf("\", \n \"srcs\": [");
+			printf("\", \n \"count\": %zu", tn->count);
+			if (counts) {
+				puts(i < tagsz - 1 ? "}," : "}");
+				continue;
+			}
+			printf(", \n \"srcs\": [");
+		} else if (counts) {
+			unescape(tn->tag);
+			printf("\t%zu\n", tn->count);
+			continue;
 		}
 		if (lf)
 			unescape(tn->tag);
-		TAILQ_FOREACH(fn, tn->fq, entries) {
+		for (j = 0; j < tn->count; j++) {
 			if (json)
 				putchar('"');
 			if (!json && lf)
 				putchar('\t');
 			if (!json && !lf)
 				printf("%s\t", tn->tag);
-			printf("%s", fn->fn);
+			printf("%s", posts[tn->post + j]);
 			if (json)
 				putchar('"');
 			if (!json && !lf)
 				putchar('\n');
-			if (json && TAILQ_NEXT(fn, entries) != NULL)
+			if (json && j < tn->count - 1)
 				putchar(',');
 		}
-		if (json && TAILQ_NEXT(tn, entries) != NULL)
+		if (json && i < tagsz - 1)
 			puts("]},");
 		else if (json)
 			puts("]}");
@@ -145,25 +163,12 @@ dorlist(const struct article *sargs, size_t sargsz, int json, int lf)
 			puts("");
 	}
 
-	/*
-	 * XXX: on Linux, the "key" value to the ENTER-created table
-	 * entries is not destroyed, so we do that later.
-	 */
-
-	hdestroy();
-
-	while ((tn = TAILQ_FIRST(&tq)) != NULL) {
-		while ((fn = TAILQ_FIRST(tn->fq)) != NULL) {
-			TAILQ_REMOVE(tn->fq, fn, entries);
-			free(fn);
-		}
-		TAILQ_REMOVE(&tq, tn, entries);
-#ifdef __linux__
-		free(tn->tag);
-#endif
-		free(tn->fq);
-		free(tn);
-	}
+	free(fill);
+	free(posts);
+	free(ids);
+	free(off);
+	free(tags);
+	tagtab_free(&tab);
 }
 
 /*
@@ -207,37 +212,38 @@ dolist(const struct article *sargs, size_t sargsz, int json, int lf)
 }
 
 /*
- * Emit all of the tags in no particular order, file-first or tag-first
- * is "reverse" was specified.
+ * Emit all of the tags, file-first or tag-first if "reverse" was
+ * specified.
+ * Tag-first output is in order of first appearance or as given by
+ * "order"; if "counts" is specified, only tags and their number of
+ * articles are printed.
  * If json is specified, format the output in JSON.
  * If long is specified, have the matched file or tags be all on one
  * line instead of one per line.
  * Returns zero on failure, non-zero on success.
  */
 int
-listtags(XML_Parser p, int sz, char *src[],
-	int json, int reverse, int longformat)
+listtags(XML_Parser p, const struct input *in, int sz, char *src[],
+	int json, int reverse, int longformat, enum tagorder order,
+	int counts)
 {
 	size_t		 sargsz = 0;
-	int		 i;
 	struct article	*sargs = NULL;
 
-	for (i = 0; i < sz; i++) 
-		if (!sblg_parse(p, src[i], &sargs, &sargsz, NULL)) {
-			sblg_free(sargs, sargsz);
-			return 0;
-		}
-
-	sblg_destroy();
+	if (!corpus_read(p, in, sz, src, 
+	    NULL, GROK_NOBODY, &sargs, &sargsz, NULL)) {
+		sblg_free(sargs, sargsz);
+		return 0;
+	}
 
 	if (json)
-		puts("{[");
+		puts("[");
 	if (reverse)
-		dorlist(sargs, sargsz, json, longformat);
+		dorlist(sargs, sargsz, json, longformat, order, counts);
 	else
 		dolist(sargs, sargsz, json, longformat);
 	if (json)
-		puts("]}");
+		puts("]");
 
 	sblg_free(sargs, sargsz);
 	return 1;
@@ -21,6 +21,7 @@
 #endif
 #include <expat.h>
 #include <getopt.h>
+#include <limits.h>
 #include <locale.h>
 #if HAVE_SANDBOX_INIT
 # include <sandbox.h>
@@ -41,19 +42,61 @@
  */
 enum	op {
 	OP_ATOM, /* generate atom feed */
+	OP_BINARY, /* binary export */
 	OP_COMPILE, /* standalone article */
 	OP_BLOG, /* amalgamation */
 	OP_LISTTAGS, /* list all tags */
-	OP_LINK_INPLACE /* amalgamation (multiple in/out) */
+	OP_LINK_INPLACE, /* amalgamation (multiple in/out) */
+	OP_SUMMARY /* article summary */
 };
 
+/*
+ * Parse a shard "i/n" (1-based) into "in".
+ * Return zero on failure, non-zero on success.
+ */
+static int
+shard_parse(const char *arg, struct input *in)
+{
+	char		 buf[64], *cp;
+	const char	*er;
+	long long	 i, n;
+
+	if (strlcpy(buf, arg, sizeof(buf)) >= sizeof(buf) ||
+	    (cp = strchr(buf, '/')) == NULL) {
+		warnx("%s: malformed shard", arg);
+		return 0;
+	}
+	*cp++ = '\0';
+
+	n = strtonum(cp, 1, INT_MAX, &er);
+	if (er != NULL) {
+		warnx("%s: shard count is %s", arg, er);
+		return 0;
+	}
+	i = strtonum(buf, 1, n, &er);
+	if (er != NULL) {
+		warnx("%s: shard is %s", arg, er);
+		return 0;
+	}
+
+	in->shard = (size_t)i - 1;
+	in->shards = (size_t)n;
+	return 1;
+}
+
 int
 main(int argc, char *argv[])
 {
-	int		 ch, i, rc, fmtjson = 0, rev = 0, lf = 0;
-	const char	*templ = NULL, *outfile = NULL, *force = NULL;
+	int		 ch, rc, fmtjson = 0, rev = 0, lf = 0,
+			 domerge = 0, tagcounts = 0;
+	size_t		 njobs = 0;
+	struct jsonopts	 jopts;
+	const char	*templ = NULL, *outfile = NULL, *force = NULL,
+			*er, *fieldarg = NULL;
 	enum op		 op = OP_BLOG;
 	enum asort	 asort = ASORT_DATE;
+	enum tagorder	 tagorder = TAGORDER_FIRST;
+	struct input	 in;
 	XML_Parser	 p;
 
 #if HAVE_SANDBOX_INIT
@@ -69,19 +112,45 @@ main(int argc, char *argv[])
 
 	setlocale(LC_ALL, "");
 
-	while (-1 != (ch = getopt(argc, argv, "acjlLrC:o:s:t:V")))
+	memset(&in, 0, sizeof(struct input));
+	memset(&jopts, 0, sizeof(struct jsonopts));
+	jopts.fields = JSON_ALL;
+
+	while (-1 != (ch = getopt(argc, argv, "0abcjklLMrxC:f:i:J:n:O:o:P:s:S:t:V")))
 		switch (ch) {
+		case '0':
+			in.gflags |= GROK_SPLIT;
+			break;
 		case 'a':
 			op = OP_ATOM;
 			break;
+		case 'b':
+			op = OP_BINARY;
+			break;
 		case 'c':
 			op = OP_COMPILE;
 			break;
 		case 'C':
 			force = optarg;
 			break;
+		case 'f':
+			fieldarg = optarg;
+			break;
+		case 'i':
+			in.summary = optarg;
+			break;
 		case 'j':
-			fmtjson = 1;
+			fmtjson++;
+			break;
+		case 'J':
+			jopts.split = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL) {
+				warnx("-J %s: %s", optarg, er);
+				goto usage;
+			}
+			break;
+		case 'k':
+			tagcounts = 1;
 			break;
 		case 'l':
 			if (op == OP_LISTTAGS)
@@ -92,9 +161,34 @@ main(int argc, char *argv[])
 		case 'L':
 			op = OP_LINK_INPLACE;
 			break;
+		case 'M':
+			domerge = 1;
+			break;
+		case 'n':
+			in.limit = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL) {
+				warnx("-n %s: %s", optarg, er);
+				goto usage;
+			}
+			break;
+		case 'O':
+			if (strcmp(optarg, "name") == 0)
+				tagorder = TAGORDER_NAME;
+			else if (strcmp(optarg, "count") == 0)
+				tagorder = TAGORDER_COUNT;
+			else
+				goto usage;
+			break;
 		case 'o':
 			outfile = optarg;
 			break;
+		case 'P':
+			njobs = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL) {
+				warnx("-P %s: %s", optarg, er);
+				goto usage;
+			}
+			break;
 		case 'r':
 			rev = 1;
 			break;
@@ -102,12 +196,19 @@ main(int argc, char *argv[])
 			if (!sblg_sort_lookup(optarg, &asort))
 				goto usage;
 			break;
+		case 'S':
+			if (!shard_parse(optarg, &in))
+				goto usage;
+			break;
 		case 't':
 			templ = optarg;
 			break;
 		case 'V':
 			fputs("sblg-" VERSION "\n", stderr);
 			return EXIT_SUCCESS;
+		case 'x':
+			op = OP_SUMMARY;
+			break;
 		default:
 			goto usage;
 		}
@@ -115,15 +216,61 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	if (argc == 0)
-		goto usage;
+	if (!inputs_expand(&argc, &argv))
+		return EXIT_FAILURE;
 
+	if (jopts.split > 0 && fmtjson == 0)
+		fmtjson = 1;
 	if (op == OP_BLOG && fmtjson)
 		op = OP_ATOM;
 
+	/*
+	 * A summary replaces the input files and may only be used by
+	 * modes that don't need the full article.
+	 * Sharding and merging only make sense for modes producing one
+	 * output per article range.
+	 */
+
+	if (in.summary != NULL) {
+		if (argc > 0 || domerge || 
+		    op == OP_COMPILE || op == OP_SUMMARY)
+			goto usage;
+	} else if (argc == 0)
+		goto usage;
+
+	if ((in.gflags & GROK_SPLIT) && (in.summary != NULL || 
+	    domerge || op == OP_COMPILE || op == OP_SUMMARY))
+		goto usage;
+	if ((tagcounts || tagorder != TAGORDER_FIRST) && 
+	    op != OP_LISTTAGS)
+		goto usage;
+	if (in.shards > 0 && op != OP_ATOM && 
+	    op != OP_BINARY && op != OP_LINK_INPLACE)
+		goto usage;
+	if (domerge && (op != OP_ATOM || in.shards > 0))
+		goto usage;
+	if (in.limit > 0 && ((op != OP_ATOM && op != OP_BINARY) || 
+	    in.shards > 0 || domerge))
+		goto usage;
+	if (fmtjson > 3 || (fmtjson > 1 && (op != OP_ATOM || domerge)))
+		goto usage;
+	if (jopts.split > 0 && 
+	    (op != OP_ATOM || in.shards > 0 || domerge || fmtjson > 1))
+		goto usage;
+	jopts.ndjson = fmtjson > 1;
+	jopts.ndhead = fmtjson > 2;
+	if (fieldarg != NULL) {
+		if (op != OP_ATOM || !fmtjson || domerge)
+			goto usage;
+		if (!json_fields(fieldarg, &jopts.fields))
+			goto usage;
+	}
+
 	if (!sblg_init())
 		err(EXIT_FAILURE, NULL);
 
+	jobs_init(njobs);
+
 	/*
 	 * Avoid constantly re-using a parser by specifying one here.
 	 * We'll just use the same one over and over whilst parsing our
@@ -141,30 +288,50 @@ main(int argc, char *argv[])
 			rc = compile(p, templ, argv[0], outfile);
 			break;
 		}
-		for (i = 0, rc = 1; rc && i < argc; i++)
-			rc = compile(p, templ, argv[i], NULL);
+		rc = compile_batch(p, templ, argc, argv);
 		break;
 	case OP_ATOM:
 		if (fmtjson) {
 			if (outfile == NULL)
 				outfile = "blog.json";
-			rc = json(p, argc, argv, outfile, asort);
+			if (!(jopts.fields & JSON_ARTICLE))
+				in.gflags |= GROK_NOBODY;
+			if (domerge)
+				rc = merge(argc, argv, outfile, 1);
+			else
+				rc = json(p, &in, argc, argv,
+					outfile, asort, &jopts);
+			break;
+		}
+		if (outfile == NULL)
+			outfile = "atom.xml";
+		if (domerge) {
+			rc = merge(argc, argv, outfile, 0);
 			break;
 		}
 		if (templ == NULL)
 			templ = "atom-template.xml";
+		rc = atom(p, templ, &in, argc, argv, outfile, asort);
+		break;
+	case OP_BINARY:
 		if (outfile == NULL)
-			outfile = "atom.xml";
-		rc = atom(p, templ, argc, argv, outfile, asort);
+			outfile = "blog.bin";
+		rc = binary(p, &in, argc, argv, outfile, asort);
 		break;
 	case OP_LISTTAGS:
-		rc = listtags(p, argc, argv,
-			fmtjson, rev, fmtjson ? 0 : lf);
+		rc = listtags(p, &in, argc, argv, fmtjson, 
+			rev || tagcounts || tagorder != TAGORDER_FIRST, 
+			fmtjson ? 0 : lf, tagorder, tagcounts);
 		break;
 	case OP_LINK_INPLACE:
 		if (templ == NULL)
 			templ = "blog-template.xml";
-		rc = linkall_r(p, templ, argc, argv, asort);
+		rc = linkall_r(p, templ, &in, argc, argv, asort);
+		break;
+	case OP_SUMMARY:
+		if (outfile == NULL)
+			outfile = "blog.tsv";
+		rc = summary(p, argc, argv, outfile, asort);
 		break;
 	default:
 		if (templ == NULL)
@@ -172,24 +339,39 @@ main(int argc, char *argv[])
 		if (outfile == NULL)
 			outfile = "blog.html";
 		rc = linkall(p, templ, force, 
-			argc, argv, outfile, asort);
+			&in, argc, argv, outfile, asort);
 		break;
 	}
 
 	sblg_destroy();
+	jobs_free();
 	XML_ParserFree(p);
+	inputs_free(argc, argv);
 	return rc ? EXIT_SUCCESS : EXIT_FAILURE;
 usage:
 	fprintf(stderr, 
-		"usage: %s [-o file] [-t templ] -c file...\n"
-		"       %s [-o file] [-t templ] [-s sort] -a file...\n"
-		"       %s [-jlr] -l file...\n"
-		"       %s [-t templ] [-s sort] -L file...\n"
-		"       %s [-o file] [-s sort] -j file...\n"
-		"       %s [-o file] [-t templ] [-s sort] -C file...\n"
-		"       %s [-o file] [-t templ] [-s sort] file...\n",
+		"usage: %s [-o file] [-P jobs] [-t templ] -c file...\n"
+		"       %s [-0] [-o file] [-P jobs] [-t templ] "
+			"[-n num | -S i/n] [-s sort] -a {-i summary | file...}\n"
+		"       %s [-0] [-o file] [-P jobs] [-n num | -S i/n] "
+			"[-s sort] -b {-i summary | file...}\n"
+		"       %s [-0jklr] [-O order] [-P jobs] "
+			"-l {-i summary | file...}\n"
+		"       %s [-0] [-P jobs] [-t templ] [-S i/n] [-s sort] "
+			"-L {-i summary | file...}\n"
+		"       %s [-0] [-f fields] [-o file] [-P jobs] "
+			"[-n num | -S i/n] [-s sort] -j[j[j]] {-i summary | file...}\n"
+		"       %s [-0] [-f fields] [-n num] [-o file] [-P jobs] "
+			"[-s sort] -J num {-i summary | file...}\n"
+		"       %s [-0] [-o file] [-P jobs] [-t templ] [-s sort] "
+			"-C {-i summary | file...}\n"
+		"       %s [-0] [-o file] [-P jobs] [-t templ] [-s sort] "
+			"{-i summary | file...}\n"
+		"       %s [-o file] [-P jobs] [-s sort] -x file...\n"
+		"       %s [-o file] [-j] -aM file...\n",
 		getprogname(), getprogname(), getprogname(), 
 		getprogname(), getprogname(), getprogname(), 
-		getprogname());
+		getprogname(), getprogname(), getprogname(),
+		getprogname(), getprogname());
 	return EXIT_FAILURE;
 }
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_LOWDOWN
+# include <sys/queue.h>
+#endif
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#if HAVE_LOWDOWN
+# include <lowdown.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * Whether "name", less any compression suffix, is Markdown.
+ */
+int
+markdown_name(const char *name)
+{
+	char	*cp;
+	size_t	 sz;
+	int	 rc;
+
+	cp = zread_name(name);
+	sz = strlen(cp);
+	rc = sz > 3 && strcasecmp(cp + sz - 3, ".md") == 0;
+	free(cp);
+	return rc;
+}
+
+#if HAVE_LOWDOWN
+
+/*
+ * Metadata keys mapped to article attributes.
+ * Others are set with data-sblg-set-key.
+ */
+static	const char *const metakeys[][2] = {
+	{ "author", "data-sblg-author" },
+	{ "date", "data-sblg-datetime" },
+	{ "image", "data-sblg-img" },
+	{ "summary", "data-sblg-aside" },
+	{ "tags", "data-sblg-tags" },
+	{ "title", "data-sblg-title" },
+	{ NULL, NULL }
+};
+
+static void
+md_puts(char **p, size_t *sz, const char *s)
+{
+
+	xmlstrtext(p, sz, s, strlen(s));
+}
+
+/*
+ * Append "s" escaped as an attribute value.
+ */
+static void
+md_attr(char **p, size_t *sz, const char *s)
+{
+	char	 c[2];
+
+	for (c[1] = '\0'; *s != '\0'; s++)
+		switch (*s) {
+		case '&':
+			md_puts(p, sz, "&amp;");
+			break;
+		case '<':
+			md_puts(p, sz, "&lt;");
+			break;
+		case '"':
+			md_puts(p, sz, "&quot;");
+			break;
+		default:
+			c[0] = *s;
+			md_puts(p, sz, c);
+			break;
+		}
+}
+
+/*
+ * Whether the metadata "mq" mark the document as an article: like the
+ * article attribute of XML documents, documents without a title or
+ * date are not articles.
+ */
+static int
+md_isarticle(const struct lowdown_metaq *mq)
+{
+	const struct lowdown_meta	*m;
+
+	TAILQ_FOREACH(m, mq, entries)
+		if (m->key != NULL && m->value != NULL &&
+		    (strcasecmp(m->key, "title") == 0 ||
+		     strcasecmp(m->key, "date") == 0))
+			return 1;
+	return 0;
+}
+
+/*
+ * Render the Markdown "buf" of size "sz" from "src" as HTML wrapped in
+ * an article element, whose attributes are set from the document's
+ * metadata, into "out" of size "outsz".
+ * If the document isn't an article, "out" is left NULL.
+ * Return zero on failure, non-zero on success.
+ */
+int
+markdown(const char *src, const char *buf, size_t sz,
+    char **out, size_t *outsz)
+{
+	struct lowdown_opts	 opts;
+	struct lowdown_metaq	 mq;
+	struct lowdown_meta	*m;
+	char			*html = NULL;
+	size_t			 htmlsz = 0, i;
+
+	*out = NULL;
+	*outsz = 0;
+
+	memset(&opts, 0, sizeof(struct lowdown_opts));
+	opts.type = LOWDOWN_HTML;
+	opts.feat = LOWDOWN_AUTOLINK | LOWDOWN_FENCED |
+		LOWDOWN_FOOTNOTES | LOWDOWN_METADATA |
+		LOWDOWN_STRIKE | LOWDOWN_TABLES;
+	opts.oflags = LOWDOWN_HTML_HEAD_IDS | LOWDOWN_HTML_NUM_ENT;
+
+	TAILQ_INIT(&mq);
+	if (!lowdown_buf(&opts, buf, sz, &html, &htmlsz, &mq)) {
+		ctxwarnx("%s: lowdown_buf", src);
+		lowdown_metaq_free(&mq);
+		return 0;
+	}
+
+	if (!md_isarticle(&mq)) {
+		free(html);
+		lowdown_metaq_free(&mq);
+		return 1;
+	}
+
+	md_puts(out, outsz, "<article data-sblg-article=\"1\"");
+	TAILQ_FOREACH(m, &mq, entries) {
+		if (m->key == NULL || m->value == NULL || *m->key == '\0')
+			continue;
+		for (i = 0; metakeys[i][0] != NULL; i++)
+			if (strcasecmp(m->key, metakeys[i][0]) == 0)
+				break;
+		md_puts(out, outsz, " ");
+		if (metakeys[i][0] != NULL)
+			md_puts(out, outsz, metakeys[i][1]);
+		else {
+			md_puts(out, outsz, "data-sblg-set-");
+			md_attr(out, outsz, m->key);
+		}
+		md_puts(out, outsz, "=\"");
+		md_attr(out, outsz, m->value);
+		md_puts(out, outsz, "\"");
+	}
+	md_puts(out, outsz, ">");
+	xmlstrtext(out, outsz, html, htmlsz);
+	md_puts(out, outsz, "</article>\n");
+
+	free(html);
+	lowdown_metaq_free(&mq);
+	return 1;
+}
+
+#else
+
+int
+markdown(const char *src, const char *buf, size_t sz,
+    char **out, size_t *outsz)
+{
+
+	*out = NULL;
+	*outsz = 0;
+	ctxwarnx("%s: Markdown support not compiled in", src);
+	return 0;
+}
+
+#endif
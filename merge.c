@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+#include "version.h"
+
+/*
+ * The envelope of JSON documents written by json().
+ */
+#define	JSON_HEAD "{\"version\":\"" VERSION "\",\"articles\": ["
+#define	JSON_TAIL "]}\n"
+
+/*
+ * A mapped input file.
+ */
+struct	mergein {
+	const char	*fn; /* file name */
+	int		 fd; /* descriptor or -1 */
+	char		*buf; /* contents */
+	size_t		 sz; /* length of contents */
+};
+
+/*
+ * Find the last occurrence of "needle" in "buf" of size "sz".
+ * Returns NULL if not found.
+ */
+static const char *
+lastof(const char *buf, size_t sz, const char *needle)
+{
+	const char	*cp, *last = NULL;
+	size_t		 nsz = strlen(needle);
+
+	while ((cp = memmem(buf, sz, needle, nsz)) != NULL) {
+		last = cp;
+		sz -= cp - buf + 1;
+		buf = cp + 1;
+	}
+	return last;
+}
+
+/*
+ * Concatenate the articles of JSON documents.
+ * Each must have been written by the same version of sblg.
+ */
+static int
+merge_json(FILE *f, const struct mergein *in, size_t insz)
+{
+	size_t	 i, hsz, tsz, bsz;
+	int	 first = 1;
+
+	hsz = strlen(JSON_HEAD);
+	tsz = strlen(JSON_TAIL);
+
+	for (i = 0; i < insz; i++)
+		if (in[i].sz < hsz + tsz ||
+		    memcmp(in[i].buf, JSON_HEAD, hsz) ||
+		    memcmp(in[i].buf + in[i].sz - tsz, JSON_TAIL, tsz)) {
+			ctxwarnx("%s: not a JSON document "
+				"from sblg-" VERSION, in[i].fn);
+			return 0;
+		}
+
+	fputs(JSON_HEAD, f);
+	for (i = 0; i < insz; i++) {
+		if ((bsz = in[i].sz - hsz - tsz) == 0)
+			continue;
+		if (!first)
+			fputc(',', f);
+		fwrite(in[i].buf + hsz, bsz, 1, f);
+		first = 0;
+	}
+	fputs(JSON_TAIL, f);
+	return 1;
+}
+
+/*
+ * Concatenate the entries of Atom feeds.
+ * The first feed is used as-is with entries of subsequent feeds being
+ * inserted after its last entry (or before its closing element if it
+ * has no entries).
+ */
+static int
+merge_atom(FILE *f, const struct mergein *in, size_t insz)
+{
+	const char	*start, *end, *ins;
+	size_t		 i;
+
+	if ((ins = lastof(in[0].buf, in[0].sz, "</entry>")) != NULL)
+		ins += strlen("</entry>");
+	else if ((ins = lastof(in[0].buf, in[0].sz, "</feed>")) == NULL) {
+		ctxwarnx("%s: not an Atom feed", in[0].fn);
+		return 0;
+	}
+
+	fwrite(in[0].buf, ins - in[0].buf, 1, f);
+
+	for (i = 1; i < insz; i++) {
+		start = memmem(in[i].buf, in[i].sz, "<entry>", 7);
+		end = lastof(in[i].buf, in[i].sz, "</entry>");
+		if (start == NULL || end == NULL || end < start)
+			continue;
+		end += strlen("</entry>");
+		fputs("\n\t", f);
+		fwrite(start, end - start, 1, f);
+	}
+
+	fwrite(ins, in[0].buf + in[0].sz - ins, 1, f);
+	return 1;
+}
+
+/*
+ * Merge the output of sharded (-S) Atom or JSON invocations.
+ * The inputs must be in shard order.
+ * Return zero on failure, non-zero on success.
+ */
+int
+merge(int sz, char *src[], const char *dst, int json)
+{
+	struct mergein	*in;
+	size_t		 i, insz = 0;
+	int		 rc = 0;
+	FILE		*f = stdout;
+
+	in = xcalloc(sz, sizeof(struct mergein));
+
+	for (i = 0; i < (size_t)sz; i++, insz++) {
+		in[i].fn = src[i];
+		if (!mmap_open(src[i], &in[i].fd, &in[i].buf, &in[i].sz))
+			goto out;
+	}
+
+	if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
+		ctxwarn("%s", dst);
+		goto out;
+	}
+
+	rc = json ? merge_json(f, in, insz) : merge_atom(f, in, insz);
+out:
+	for (i = 0; i < insz; i++)
+		mmap_close(in[i].fd, in[i].buf, in[i].sz);
+	free(in);
+	if (f != NULL && f != stdout)
+		fclose(f);
+	return rc;
+}
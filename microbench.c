@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sblg.h"
+#include "extern.h"
+
+/*
+ * Microbenchmarks of the library's hot kernels, linked against sblg.a.
+ * Each kernel is run in batches until a batch takes long enough to
+ * time, then the batch is repeated and the fastest kept.
+ * Results are written as JSON in ns/op and input bytes/s.
+ * It's run by "make microbench" and isn't installed.
+ */
+
+/*
+ * Inputs shared by all kernels, built once by fixture_init().
+ */
+struct	fixture {
+	struct article	 *arts; /* parsed articles, shuffled */
+	struct article	 *sorted; /* scratch copy for sorting */
+	size_t		  artsz; /* number of articles */
+	char		 *text; /* body text with markup characters */
+	char		 *templ; /* text with ${sblg-xxx} */
+	FILE		 *null; /* /dev/null for output */
+	uint64_t	  state; /* generator state */
+};
+
+struct	kernel {
+	const char	*name;
+	/*
+	 * Run "iters" operations and return the input bytes they
+	 * processed, or zero if that's meaningless for the kernel.
+	 */
+	uint64_t	(*fn)(struct fixture *, const struct kernel *, size_t);
+	int		 arg; /* escape mode or sort type */
+};
+
+static	const char *const words[] = {
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+	"adipiscing", "elit", "sed", "do", "eiusmod", "tempor",
+	"incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua",
+	"Enim", "Ad", "Minim", "veniam", "quis", "nostrud",
+	"exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex",
+	"ea", "commodo", "consequat",
+};
+
+#define	WORDSZ	(sizeof(words) / sizeof(words[0]))
+
+/*
+ * Element, attribute, and unknown names looked up in templates.
+ */
+static	const char *const lookups[] = {
+	"article", "data-sblg-article", "div", "nav", "h1", "p",
+	"data-sblg-nav", "time", "datetime", "class", "address", "a",
+	"data-sblg-navsz", "href", "aside", "span", "img", "src",
+	"data-sblg-tags", "li", "data-sblg-set-key0", "section", "ul",
+	"data-sblg-navstyle-content", "header", "em", "title", "b",
+	"data-sblg-permlink", "footer", "data-sblg-sort", "code",
+};
+
+#define	LOOKUPSZ (sizeof(lookups) / sizeof(lookups[0]))
+
+static	const char *const openatts[] = {
+	"href", "a0.html",
+	"class", "sblg-nav-link",
+	"title", "An \"article\" & <more>",
+	NULL
+};
+
+static	const char *const tagstr =
+	"misc travel food\\ and\\ drink photos travel code c "
+	"BSD open\\ source misc";
+
+/*
+ * xorshift64*: fast, deterministic across platforms.
+ */
+static uint64_t
+rnd(struct fixture *fx)
+{
+
+	fx->state ^= fx->state >> 12;
+	fx->state ^= fx->state << 25;
+	fx->state ^= fx->state >> 27;
+	return fx->state * UINT64_C(2685821657736338717);
+}
+
+static const char *
+rndword(struct fixture *fx)
+{
+
+	return words[rnd(fx) % WORDSZ];
+}
+
+/*
+ * Parse "n" generated articles through the library, then shuffle them
+ * so sorts have work to do.
+ * Also build the text inputs.
+ */
+static void
+fixture_init(struct fixture *fx, size_t n)
+{
+	XML_Parser	 p;
+	char		*buf, name[64];
+	size_t		 bufsz, i, j;
+	struct article	 tmp;
+	struct tm	 tm;
+	time_t		 t;
+	const char	*esc, *word;
+	int		 rc;
+
+	memset(fx, 0, sizeof(struct fixture));
+	fx->state = 1;
+
+	if (!sblg_init())
+		errx(EXIT_FAILURE, "sblg_init");
+	if ((p = XML_ParserCreate(NULL)) == NULL)
+		err(EXIT_FAILURE, NULL);
+	if ((fx->null = fopen("/dev/null", "w")) == NULL)
+		err(EXIT_FAILURE, "/dev/null");
+
+	for (i = 0; i < n; i++) {
+		t = (time_t)946684800 + (time_t)(rnd(fx) % 7300) * 86400;
+		gmtime_r(&t, &tm);
+		snprintf(name, sizeof(name), "a%zu.xml", i);
+		rc = asprintf(&buf,
+		    "<article data-sblg-article=\"1\" "
+		    "data-sblg-tags=\"tag%d tag%d\" "
+		    "data-sblg-set-key0=\"%s\">"
+		    "<h1>%s %s &amp; %s</h1>"
+		    "<address>%s %s</address>"
+		    "<time datetime=\"%04d-%02d-%02d\" />"
+		    "<aside>%s <b>%s</b> %s</aside>"
+		    "<p>%s %s %s %s</p></article>",
+		    (int)(rnd(fx) % 16), (int)(rnd(fx) % 16), rndword(fx),
+		    rndword(fx), rndword(fx), rndword(fx),
+		    rndword(fx), rndword(fx),
+		    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+		    rndword(fx), rndword(fx), rndword(fx),
+		    rndword(fx), rndword(fx), rndword(fx),
+		    rndword(fx));
+		if (rc == -1)
+			err(EXIT_FAILURE, NULL);
+		if (!sblg_parse_buffer(p, name, buf, rc, t,
+		    &fx->arts, &fx->artsz, NULL))
+			errx(EXIT_FAILURE, "%s: parse failed", name);
+		free(buf);
+	}
+	XML_ParserFree(p);
+
+	if (fx->artsz == 0)
+		errx(EXIT_FAILURE, "no articles");
+
+	for (i = fx->artsz - 1; i > 0; i--) {
+		j = rnd(fx) % (i + 1);
+		tmp = fx->arts[i];
+		fx->arts[i] = fx->arts[j];
+		fx->arts[j] = tmp;
+	}
+	fx->sorted = xcalloc(fx->artsz, sizeof(struct article));
+
+	/* About 4 KB of prose with characters needing escape. */
+
+	buf = NULL;
+	bufsz = 0;
+	while (bufsz < 4096) {
+		switch (rnd(fx) % 24) {
+		case 0:
+			esc = "&";
+			break;
+		case 1:
+			esc = "<";
+			break;
+		case 2:
+			esc = ">";
+			break;
+		case 3:
+			esc = "\"";
+			break;
+		case 4:
+			esc = "\n";
+			break;
+		default:
+			esc = " ";
+			break;
+		}
+		word = rndword(fx);
+		xmlstrtext(&buf, &bufsz, word, strlen(word));
+		xmlstrtext(&buf, &bufsz, esc, 1);
+	}
+	fx->text = buf;
+
+	fx->templ = xstrdup("<li><a href=\"${sblg-base}.html\">"
+		"${sblg-title}</a> by ${sblg-author} on "
+		"<time>${sblg-date}</time>: ${sblg-aside} "
+		"[${sblg-get|key0}] ${sblg-tags}</li>\n");
+}
+
+static void
+fixture_free(struct fixture *fx)
+{
+
+	sblg_free(fx->arts, fx->artsz);
+	free(fx->sorted);
+	free(fx->text);
+	free(fx->templ);
+	fclose(fx->null);
+}
+
+/*
+ * Substitute the template for each article in turn.
+ */
+static uint64_t
+k_xmltextx(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	size_t	 i, pos, len = strlen(fx->templ);
+
+	for (i = 0; i < iters; i++) {
+		pos = i % fx->artsz;
+		xmltextx(fx->null, fx->templ, "index.html", fx->arts,
+			fx->artsz, fx->artsz, pos, pos, fx->artsz,
+			k->arg);
+	}
+	return (uint64_t)iters * len;
+}
+
+/*
+ * Escape text without substitutions: this is the xmltextxesc() loop
+ * run from xmltextx().
+ */
+static uint64_t
+k_escape(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	size_t	 i, len = strlen(fx->text);
+
+	for (i = 0; i < iters; i++)
+		xmltextx(fx->null, fx->text, "index.html", fx->arts,
+			fx->artsz, fx->artsz, 0, 0, fx->artsz, k->arg);
+	return (uint64_t)iters * len;
+}
+
+/*
+ * Append 32-byte chunks as character data arrives from expat,
+ * starting over every 128 chunks.
+ */
+static uint64_t
+k_xmlstrtext(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	char	*buf = NULL;
+	size_t	 i, sz = 0;
+
+	for (i = 0; i < iters; i++) {
+		if (i % 128 == 0) {
+			free(buf);
+			buf = NULL;
+			sz = 0;
+		}
+		xmlstrtext(&buf, &sz, fx->text + (i % 64) * 32, 32);
+	}
+	free(buf);
+	return (uint64_t)iters * 32;
+}
+
+/*
+ * Append element openings with attributes, starting over every 64.
+ */
+static uint64_t
+k_xmlstropen(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	char		*buf = NULL;
+	size_t		 i, sz = 0, prev;
+	uint64_t	 bytes = 0;
+
+	for (i = 0; i < iters; i++) {
+		if (i % 64 == 0) {
+			free(buf);
+			buf = NULL;
+			sz = 0;
+		}
+		prev = sz;
+		xmlstropen(&buf, &sz, i % 2 ? "a" : "img",
+			(const char **)openatts, NULL);
+		bytes += sz - prev;
+	}
+	free(buf);
+	return bytes;
+}
+
+/*
+ * Tokenise a tag list with duplicates and escaped spaces.
+ * With "arg", also expand ${sblg-get|key0} from the article.
+ */
+static uint64_t
+k_hashtag(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	char		**map;
+	const char	 *in;
+	size_t		  i, j, mapsz;
+
+	in = k->arg ? "post-${sblg-get|key0} misc ${sblg-get|key1}" :
+		tagstr;
+
+	for (i = 0; i < iters; i++) {
+		map = NULL;
+		mapsz = 0;
+		hashtag(&map, &mapsz, in, fx->arts, fx->artsz,
+			k->arg ? (ssize_t)(i % fx->artsz) : -1);
+		for (j = 0; j < mapsz; j++)
+			free(map[j]);
+		free(map);
+	}
+	return (uint64_t)iters * strlen(in);
+}
+
+static uint64_t
+k_lookup(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	size_t		 i;
+	uint64_t	 bytes = 0;
+	volatile int	 sink = 0;
+
+	for (i = 0; i < iters; i++) {
+		sink += sblg_lookup(lookups[i % LOOKUPSZ]);
+		bytes += strlen(lookups[i % LOOKUPSZ]);
+	}
+	(void)sink;
+	return bytes;
+}
+
+/*
+ * Sort the shuffled articles, copied afresh each time.
+ * The copy is a small fraction of the sort.
+ */
+static uint64_t
+k_sort(struct fixture *fx, const struct kernel *k, size_t iters)
+{
+	size_t	 i;
+
+	for (i = 0; i < iters; i++) {
+		memcpy(fx->sorted, fx->arts,
+			fx->artsz * sizeof(struct article));
+		sblg_sort(fx->sorted, fx->artsz, k->arg);
+	}
+	return 0;
+}
+
+static	const struct kernel kernels[] = {
+	{ "xmltextx", k_xmltextx, XMLESC_NONE },
+	{ "xmltextx-html", k_xmltextx, XMLESC_HTML },
+	{ "xmltextxesc-attr", k_escape, XMLESC_ATTR },
+	{ "xmltextxesc-html", k_escape, XMLESC_HTML },
+	{ "xmltextxesc-ws", k_escape, XMLESC_WS },
+	{ "xmlstrtext", k_xmlstrtext, 0 },
+	{ "xmlstropen", k_xmlstropen, 0 },
+	{ "hashtag", k_hashtag, 0 },
+	{ "hashtag-get", k_hashtag, 1 },
+	{ "sblg_lookup", k_lookup, 0 },
+	{ "sblg_sort-date", k_sort, ASORT_DATE },
+	{ "sblg_sort-rdate", k_sort, ASORT_RDATE },
+	{ "sblg_sort-filename", k_sort, ASORT_FILENAME },
+	{ "sblg_sort-rfilename", k_sort, ASORT_RFILENAME },
+	{ "sblg_sort-cmdline", k_sort, ASORT_CMDLINE },
+	{ "sblg_sort-rcmdline", k_sort, ASORT_RCMDLINE },
+	{ "sblg_sort-title", k_sort, ASORT_TITLE },
+	{ "sblg_sort-rtitle", k_sort, ASORT_RTITLE },
+	{ "sblg_sort-ititle", k_sort, ASORT_ITITLE },
+	{ "sblg_sort-rititle", k_sort, ASORT_RITITLE },
+	{ NULL, NULL, 0 }
+};
+
+static double
+now(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Grow the batch until it takes at least "mintime" seconds, then take
+ * the fastest of "reps" batches.
+ * Writes the JSON object for the kernel to "out".
+ */
+static void
+measure(FILE *out, struct fixture *fx, const struct kernel *k,
+    double mintime, size_t reps)
+{
+	size_t		 iters = 1, i;
+	double		 t, best = 0.0;
+	uint64_t	 bytes = 0;
+
+	for (;;) {
+		t = now();
+		bytes = k->fn(fx, k, iters);
+		if ((t = now() - t) >= mintime || iters > SIZE_MAX / 2)
+			break;
+		iters *= 2;
+	}
+
+	for (best = t, i = 1; i < reps; i++) {
+		t = now();
+		k->fn(fx, k, iters);
+		if ((t = now() - t) < best)
+			best = t;
+	}
+
+	fprintf(out, "    {\"kernel\": \"%s\", \"ops\": %zu, "
+	    "\"ns_per_op\": %.2f, \"bytes_per_sec\": ",
+	    k->name, iters, best * 1e9 / iters);
+	if (bytes > 0 && best > 0.0)
+		fprintf(out, "%.0f}", bytes / best);
+	else
+		fputs("null}", out);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct fixture	 fx;
+	const char	*only = NULL, *outf = NULL, *er;
+	FILE		*out = stdout;
+	size_t		 i, n = 1000, reps = 5, ms = 100;
+	int		 ch, first;
+
+	while ((ch = getopt(argc, argv, "k:n:o:r:t:")) != -1)
+		switch (ch) {
+		case 'k':
+			only = optarg;
+			break;
+		case 'n':
+			n = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL)
+				errx(EXIT_FAILURE, "-n %s: %s", optarg, er);
+			break;
+		case 'o':
+			outf = optarg;
+			break;
+		case 'r':
+			reps = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL)
+				errx(EXIT_FAILURE, "-r %s: %s", optarg, er);
+			break;
+		case 't':
+			ms = strtonum(optarg, 1, INT_MAX, &er);
+			if (er != NULL)
+				errx(EXIT_FAILURE, "-t %s: %s", optarg, er);
+			break;
+		default:
+			goto usage;
+		}
+
+	if (optind != argc)
+		goto usage;
+
+	if (outf != NULL && (out = fopen(outf, "w")) == NULL)
+		err(EXIT_FAILURE, "%s", outf);
+
+	fixture_init(&fx, n);
+
+	fprintf(out, "{\"articles\": %zu, \"reps\": %zu, "
+	    "\"min_ms\": %zu,\n \"kernels\": [\n", fx.artsz, reps, ms);
+	for (first = 1, i = 0; kernels[i].name != NULL; i++) {
+		if (only != NULL &&
+		    strncmp(kernels[i].name, only, strlen(only)))
+			continue;
+		if (!first)
+			fputs(",\n", out);
+		first = 0;
+		measure(out, &fx, &kernels[i], ms / 1e3, reps);
+		fflush(out);
+	}
+	fputs("\n ]\n}\n", out);
+
+	fixture_free(&fx);
+	if (out != stdout) {
+		if (fflush(out) == EOF || ferror(out))
+			err(EXIT_FAILURE, "%s", outf);
+		fclose(out);
+	}
+	return EXIT_SUCCESS;
+usage:
+	fprintf(stderr, "usage: %s [-k kernel] [-n articles] "
+	    "[-o file] [-r reps] [-t ms]\n", getprogname());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sblgbin.h"
+
+/*
+ * Print every field of the sblg -b output read from standard input, as
+ * a third-party reader would see it, for "make regress".
+ */
+
+static	const char *const strs[SBLGBIN_STR__MAX] = {
+	"src", /* SBLGBIN_SRC */
+	"base", /* SBLGBIN_BASE */
+	"stripsrc", /* SBLGBIN_STRIPSRC */
+	"stripbase", /* SBLGBIN_STRIPBASE */
+	"striplangbase", /* SBLGBIN_STRIPLANGBASE */
+	"real", /* SBLGBIN_REAL */
+	"title", /* SBLGBIN_TITLE */
+	"titletext", /* SBLGBIN_TITLETEXT */
+	"aside", /* SBLGBIN_ASIDE */
+	"asidetext", /* SBLGBIN_ASIDETEXT */
+	"author", /* SBLGBIN_AUTHOR */
+	"authortext", /* SBLGBIN_AUTHORTEXT */
+	"article", /* SBLGBIN_ARTICLE */
+	"img", /* SBLGBIN_IMG */
+};
+
+int
+main(void)
+{
+	struct sblgbin	 b;
+	char		*buf = NULL;
+	const char	*cp;
+	size_t		 sz = 0, max = 0, i, j, len;
+
+	for (;;) {
+		if (sz == max &&
+		    (buf = realloc(buf, max = max ? max * 2 : 4096)) == NULL)
+			return EXIT_FAILURE;
+		if ((len = fread(buf + sz, 1, max - sz, stdin)) == 0)
+			break;
+		sz += len;
+	}
+	if (ferror(stdin) || !sblgbin_open(&b, buf, sz)) {
+		fputs("sblgbin: bad input\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	printf("articles: %zu\n", sblgbin_count(&b));
+	for (i = 0; i < sblgbin_count(&b); i++) {
+		printf("article %zu:\n", i);
+		for (j = 0; j < SBLGBIN_STR__MAX; j++) {
+			cp = sblgbin_str(&b, i, j, &len);
+			if (cp == NULL)
+				printf("  %s: (null)\n", strs[j]);
+			else
+				printf("  %s: %zu [%s]\n", strs[j], len, cp);
+		}
+		printf("  time: %" PRId64 "\n", sblgbin_time(&b, i));
+		printf("  flags: %" PRIu32 "\n", sblgbin_flags(&b, i));
+		for (j = 0; j < sblgbin_ntags(&b, i); j++)
+			printf("  tag: %s\n", sblgbin_tag(&b, i, j, NULL));
+		for (j = 0; j < sblgbin_nkeys(&b, i); j++)
+			printf("  key: %s=%s\n", sblgbin_key(&b, i, j, NULL),
+				sblgbin_value(&b, i, j, NULL));
+	}
+
+	free(buf);
+	return EXIT_SUCCESS;
+}
@@ -142,6 +142,46 @@ struct	article {
 	size_t		  order; /* cmdline sort order */
 };
 
+/*
+ * A parsing context with its own parser and error reporting, so that
+ * threads may parse at once, each with its own context.
+ * Functions taking a context report errors, including running out of
+ * memory, to it and return failure instead of exiting.
+ */
+struct	sblg_ctx;
+
+/*
+ * Receives each error message (without a newline) of functions using a
+ * context.
+ */
+typedef	void (*sblg_errfn)(void *, const char *);
+
+/*
+ * Receives rendered output: returns zero on failure, non-zero on
+ * success.
+ */
+typedef	int (*sblg_writefn)(void *, const char *, size_t);
+
+/*
+ * What sblg_ctx_render() produces.
+ */
+enum	sblg_render {
+	SBLG_RENDER_ARTICLE, /* standalone article (like -c) */
+	SBLG_RENDER_BLOG, /* blog page (the default mode) */
+	SBLG_RENDER_ATOM, /* Atom feed (like -a) */
+	SBLG_RENDER_JSON /* JSON (like -j) */
+};
+
+/*
+ * A growable buffer filled by sblg_buf_write().
+ * Zero it before use.
+ */
+struct	sblg_buf {
+	char		*buf; /* NUL-terminated output */
+	size_t		 sz; /* length of output */
+	size_t		 max; /* allocated size */
+};
+
 __BEGIN_DECLS
 
 int		sblg_init(void);
@@ -150,10 +190,32 @@ enum sblgtag	sblg_lookup(const char *);
 
 int		sblg_parse(XML_Parser, const char *,
 			struct article **, size_t *, const char **);
+int		sblg_parse_buffer(XML_Parser, const char *,
+			const char *, size_t, time_t,
+			struct article **, size_t *, const char **);
 void		sblg_free(struct article *, size_t);
 void		sblg_sort(struct article *, size_t, enum asort);
+void		sblg_sort_top(struct article *, size_t, size_t,
+			enum asort);
 int		sblg_sort_lookup(const char *, enum asort *);
 
+struct sblg_ctx	*sblg_ctx_alloc(void);
+void		sblg_ctx_errfn(struct sblg_ctx *, sblg_errfn, void *);
+void		sblg_ctx_free(struct sblg_ctx *);
+int		sblg_ctx_parse(struct sblg_ctx *, const char *,
+			struct article **, size_t *, const char **);
+int		sblg_ctx_parse_buffer(struct sblg_ctx *, const char *,
+			const char *, size_t, time_t,
+			struct article **, size_t *, const char **);
+int		sblg_ctx_sort(struct sblg_ctx *, struct article *,
+			size_t, enum asort);
+int		sblg_ctx_sort_top(struct sblg_ctx *, struct article *,
+			size_t, size_t, enum asort);
+int		sblg_ctx_render(struct sblg_ctx *, enum sblg_render,
+			const char *, int, char *[], enum asort,
+			sblg_writefn, void *);
+int		sblg_buf_write(void *, const char *, size_t);
+
 __END_DECLS
 
 #endif 
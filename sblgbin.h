@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef SBLGBIN_H
+#define SBLGBIN_H
+
+/*
+ * Reader for the binary export written by sblg -b.
+ * This file stands alone: copy it into your sources and point
+ * sblgbin_open() at the file's contents, usually mapped with mmap(2).
+ * Nothing is copied or allocated, and fields may be read in any order.
+ *
+ * All integers are little-endian and unsigned unless noted.
+ * The file is laid out as follows, with offsets from the start of the
+ * file and each section aligned to eight bytes:
+ *
+ *   header    SBLGBIN_HEADSZ bytes
+ *   articles  "narts" records of "recsz" bytes each, sorted
+ *   lists     "nlists" string references for tags and keys
+ *   pool      "poolsz" bytes of NUL-terminated strings
+ *
+ * The header:
+ *
+ *   0   magic       8 bytes, SBLGBIN_MAGIC
+ *   8   version     4 bytes, SBLGBIN_VERSION
+ *   12  recsz       4 bytes, size of an article record
+ *   16  nstrs       4 bytes, string references per record
+ *   20  narts       4 bytes, number of articles
+ *   24  arts        8 bytes, offset of article records
+ *   32  lists       8 bytes, offset of list entries
+ *   40  nlists      4 bytes, number of list entries
+ *   44  (reserved)  4 bytes, zero
+ *   48  pool        8 bytes, offset of string pool
+ *   56  poolsz      8 bytes, size of string pool
+ *
+ * A string reference is 8 bytes: the 4-byte offset of the string in the
+ * pool and its 4-byte length, not including the terminating NUL.
+ * An offset of SBLGBIN_NULL marks a string that isn't set.
+ *
+ * An article record is "nstrs" string references in the order of enum
+ * sblgbin_str followed by:
+ *
+ *   0   time        8 bytes, signed seconds since the epoch
+ *   8   flags       4 bytes, SBLGBIN_DATETIME if time has a time
+ *   12  sort        4 bytes, 0 (none), 1 (first), or 2 (last)
+ *   16  order       4 bytes, command-line order from 1
+ *   20  tags        4 bytes, index of the first tag in lists
+ *   24  ntags       4 bytes, number of tags
+ *   28  keys        4 bytes, index of the first key in lists
+ *   32  nkeys       4 bytes, number of keys
+ *
+ * Keys are followed in the lists by their values, so key "i" of an
+ * article is at "keys + i * 2" and its value at "keys + i * 2 + 1".
+ *
+ * Readers must check the version and may accept larger "recsz" and
+ * "nstrs" values: these grow only by appending fields.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define	SBLGBIN_MAGIC	 "sblgbin"
+#define	SBLGBIN_VERSION	 1
+#define	SBLGBIN_HEADSZ	 64
+#define	SBLGBIN_NULL	 0xffffffffU
+#define	SBLGBIN_DATETIME 0x01
+
+enum	sblgbin_str {
+	SBLGBIN_SRC = 0,
+	SBLGBIN_BASE,
+	SBLGBIN_STRIPSRC,
+	SBLGBIN_STRIPBASE,
+	SBLGBIN_STRIPLANGBASE,
+	SBLGBIN_REAL,
+	SBLGBIN_TITLE,
+	SBLGBIN_TITLETEXT,
+	SBLGBIN_ASIDE,
+	SBLGBIN_ASIDETEXT,
+	SBLGBIN_AUTHOR,
+	SBLGBIN_AUTHORTEXT,
+	SBLGBIN_ARTICLE,
+	SBLGBIN_IMG,
+	SBLGBIN_STR__MAX
+};
+
+#define	SBLGBIN_RECSZ	 (SBLGBIN_STR__MAX * 8 + 36 + 4)
+
+struct	sblgbin {
+	const unsigned char	*buf; /* file contents */
+	size_t			 sz; /* size of file */
+	uint32_t		 recsz; /* record size */
+	uint32_t		 nstrs; /* strings per record */
+	uint32_t		 narts; /* number of articles */
+	uint64_t		 arts; /* offset of records */
+	uint64_t		 lists; /* offset of lists */
+	uint32_t		 nlists; /* number of list entries */
+	uint64_t		 pool; /* offset of pool */
+	uint64_t		 poolsz; /* size of pool */
+};
+
+static inline uint32_t
+sblgbin_u32(const unsigned char *p)
+{
+
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t
+sblgbin_u64(const unsigned char *p)
+{
+
+	return (uint64_t)sblgbin_u32(p) |
+		(uint64_t)sblgbin_u32(p + 4) << 32;
+}
+
+/*
+ * Check the header of "buf" of size "sz" and fill in "b".
+ * Returns zero if the file is truncated, not a binary export, or of an
+ * unknown version; non-zero on success.
+ */
+static inline int
+sblgbin_open(struct sblgbin *b, const void *buf, size_t sz)
+{
+	const unsigned char	*p = buf;
+
+	memset(b, 0, sizeof(struct sblgbin));
+	if (sz < SBLGBIN_HEADSZ ||
+	    memcmp(p, SBLGBIN_MAGIC, sizeof(SBLGBIN_MAGIC)) != 0 ||
+	    sblgbin_u32(p + 8) != SBLGBIN_VERSION)
+		return 0;
+
+	b->buf = p;
+	b->sz = sz;
+	b->recsz = sblgbin_u32(p + 12);
+	b->nstrs = sblgbin_u32(p + 16);
+	b->narts = sblgbin_u32(p + 20);
+	b->arts = sblgbin_u64(p + 24);
+	b->lists = sblgbin_u64(p + 32);
+	b->nlists = sblgbin_u32(p + 40);
+	b->pool = sblgbin_u64(p + 48);
+	b->poolsz = sblgbin_u64(p + 56);
+
+	if (b->nstrs < SBLGBIN_STR__MAX ||
+	    b->recsz < (uint64_t)b->nstrs * 8 + 36 ||
+	    b->arts > sz || (sz - b->arts) / b->recsz < b->narts ||
+	    b->lists > sz || (sz - b->lists) / 8 < b->nlists ||
+	    b->pool > sz || sz - b->pool < b->poolsz) {
+		memset(b, 0, sizeof(struct sblgbin));
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Resolve the string reference at "p".
+ * Returns NULL if the string isn't set or is out of bounds.
+ */
+static inline const char *
+sblgbin_ref(const struct sblgbin *b, const unsigned char *p, size_t *sz)
+{
+	uint32_t	 off = sblgbin_u32(p), len = sblgbin_u32(p + 4);
+
+	if (sz != NULL)
+		*sz = 0;
+	if (off == SBLGBIN_NULL || off >= b->poolsz ||
+	    b->poolsz - off <= len || b->buf[b->pool + off + len] != '\0')
+		return NULL;
+	if (sz != NULL)
+		*sz = len;
+	return (const char *)b->buf + b->pool + off;
+}
+
+static inline const unsigned char *
+sblgbin_rec(const struct sblgbin *b, size_t art)
+{
+
+	return b->buf + b->arts + art * b->recsz;
+}
+
+static inline const unsigned char *
+sblgbin_fields(const struct sblgbin *b, size_t art)
+{
+
+	return sblgbin_rec(b, art) + b->nstrs * 8;
+}
+
+/*
+ * Number of articles.
+ */
+static inline size_t
+sblgbin_count(const struct sblgbin *b)
+{
+
+	return b->narts;
+}
+
+/*
+ * String "str" of article "art", with its length in "sz" if not NULL.
+ * Returns NULL if the string isn't set.
+ */
+static inline const char *
+sblgbin_str(const struct sblgbin *b, size_t art,
+	enum sblgbin_str str, size_t *sz)
+{
+
+	if (art >= b->narts || (unsigned int)str >= b->nstrs) {
+		if (sz != NULL)
+			*sz = 0;
+		return NULL;
+	}
+	return sblgbin_ref(b, sblgbin_rec(b, art) + str * 8, sz);
+}
+
+static inline int64_t
+sblgbin_time(const struct sblgbin *b, size_t art)
+{
+
+	return art < b->narts ?
+		(int64_t)sblgbin_u64(sblgbin_fields(b, art)) : 0;
+}
+
+static inline uint32_t
+sblgbin_flags(const struct sblgbin *b, size_t art)
+{
+
+	return art < b->narts ?
+		sblgbin_u32(sblgbin_fields(b, art) + 8) : 0;
+}
+
+static inline size_t
+sblgbin_ntags(const struct sblgbin *b, size_t art)
+{
+
+	return art < b->narts ?
+		sblgbin_u32(sblgbin_fields(b, art) + 24) : 0;
+}
+
+static inline size_t
+sblgbin_nkeys(const struct sblgbin *b, size_t art)
+{
+
+	return art < b->narts ?
+		sblgbin_u32(sblgbin_fields(b, art) + 32) : 0;
+}
+
+/*
+ * List entry "idx", used for tags, keys, and values.
+ */
+static inline const char *
+sblgbin_list(const struct sblgbin *b, uint64_t idx, size_t *sz)
+{
+
+	if (idx >= b->nlists) {
+		if (sz != NULL)
+			*sz = 0;
+		return NULL;
+	}
+	return sblgbin_ref(b, b->buf + b->lists + idx * 8, sz);
+}
+
+/*
+ * Tag "i" of article "art" or NULL if out of range.
+ */
+static inline const char *
+sblgbin_tag(const struct sblgbin *b, size_t art, size_t i, size_t *sz)
+{
+
+	if (i >= sblgbin_ntags(b, art))
+		return sblgbin_list(b, UINT64_MAX, sz);
+	return sblgbin_list(b, (uint64_t)sblgbin_u32
+		(sblgbin_fields(b, art) + 20) + i, sz);
+}
+
+/*
+ * Key "i" of article "art" or NULL if out of range.
+ */
+static inline const char *
+sblgbin_key(const struct sblgbin *b, size_t art, size_t i, size_t *sz)
+{
+
+	if (i >= sblgbin_nkeys(b, art))
+		return sblgbin_list(b, UINT64_MAX, sz);
+	return sblgbin_list(b, (uint64_t)sblgbin_u32
+		(sblgbin_fields(b, art) + 28) + i * 2, sz);
+}
+
+/*
+ * Value of key "i" of article "art" or NULL if out of range.
+ */
+static inline const char *
+sblgbin_value(const struct sblgbin *b, size_t art, size_t i, size_t *sz)
+{
+
+	if (i >= sblgbin_nkeys(b, art))
+		return sblgbin_list(b, UINT64_MAX, sz);
+	return sblgbin_list(b, (uint64_t)sblgbin_u32
+		(sblgbin_fields(b, art) + 28) + i * 2 + 1, sz);
+}
+
+#endif /* !SBLGBIN_H */
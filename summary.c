@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * The summary is a line-based file.
+ * The first line is the SUMMARY_MAGIC and SUMMARY_VERSION separated by
+ * a tab.
+ * Each subsequent line is an article of tab-separated fields in the
+ * order of "sumstrs", then the time, whether the time has a date, the
+ * sort override, the command-line order, the position in the file, the
+ * number of tags, the tags, the number of keys, then the key-value
+ * pairs.
+ * Backslash, tab, carriage return, and newline are escaped as in C; a
+ * NULL string is "\N".
+ */
+#define	SUMMARY_MAGIC	 "sblg-summary"
+#define	SUMMARY_VERSION	 1
+
+/*
+ * String fields in the order they're written.
+ */
+static	const size_t sumstrs[] = {
+	offsetof(struct article, real),
+	offsetof(struct article, stripreal),
+	offsetof(struct article, realbase),
+	offsetof(struct article, striprealbase),
+	offsetof(struct article, striplangrealbase),
+	offsetof(struct article, src),
+	offsetof(struct article, base),
+	offsetof(struct article, stripsrc),
+	offsetof(struct article, stripbase),
+	offsetof(struct article, striplangbase),
+	offsetof(struct article, title),
+	offsetof(struct article, titletext),
+	offsetof(struct article, aside),
+	offsetof(struct article, asidetext),
+	offsetof(struct article, author),
+	offsetof(struct article, authortext),
+	offsetof(struct article, img),
+};
+
+#define	SUMSTRSZ (sizeof(sumstrs) / sizeof(sumstrs[0]))
+
+#define	SUMSTR(_a, _i) \
+	(*(char **)((char *)(_a) + sumstrs[(_i)]))
+
+/*
+ * A tab-separated field within a line (not NUL-terminated).
+ */
+struct	sumfield {
+	const char	*cp;
+	size_t		 sz;
+};
+
+static void
+sum_puts(FILE *f, const char *cp)
+{
+
+	if (cp == NULL) {
+		fputs("\\N", f);
+		return;
+	}
+
+	for ( ; *cp != '\0'; cp++)
+		switch (*cp) {
+		case '\\':
+			fputs("\\\\", f);
+			break;
+		case '\t':
+			fputs("\\t", f);
+			break;
+		case '\n':
+			fputs("\\n", f);
+			break;
+		case '\r':
+			fputs("\\r", f);
+			break;
+		default:
+			fputc(*cp, f);
+			break;
+		}
+}
+
+/*
+ * Unescape the field "fl" into a NUL-terminated string.
+ * Returns NULL if the field is the NULL marker.
+ */
+static char *
+sum_str(const struct sumfield *fl)
+{
+	char	*p;
+	size_t	 i, j;
+
+	if (fl->sz == 2 && fl->cp[0] == '\\' && fl->cp[1] == 'N')
+		return NULL;
+
+	p = xmalloc(fl->sz + 1);
+	for (i = j = 0; i < fl->sz; i++) {
+		if (fl->cp[i] != '\\' || i + 1 == fl->sz) {
+			p[j++] = fl->cp[i];
+			continue;
+		}
+		switch (fl->cp[++i]) {
+		case 't':
+			p[j++] = '\t';
+			break;
+		case 'n':
+			p[j++] = '\n';
+			break;
+		case 'r':
+			p[j++] = '\r';
+			break;
+		default:
+			p[j++] = fl->cp[i];
+			break;
+		}
+	}
+	p[j] = '\0';
+	return p;
+}
+
+/*
+ * Parse a numeric field within the given (inclusive) range.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+sum_num(const struct sumfield *fl, long long min, long long max,
+	long long *val)
+{
+	char		*cp;
+	const char	*er;
+
+	if ((cp = sum_str(fl)) == NULL)
+		return 0;
+	*val = strtonum(cp, min, max, &er);
+	free(cp);
+	return er == NULL;
+}
+
+/*
+ * Fill in the article "art" and its position in its file "pos" from the
+ * line's fields.
+ * Returns zero on failure (malformed line), non-zero on success.
+ */
+static int
+sum_article(struct article *art, size_t *pos,
+	const struct sumfield *fl, size_t flsz)
+{
+	size_t		 i, j, n;
+	long long	 v;
+
+	if (flsz < SUMSTRSZ + 7)
+		return 0;
+
+	for (i = 0; i < SUMSTRSZ; i++)
+		SUMSTR(art, i) = sum_str(&fl[i]);
+
+	for (i = 0; i < SUMSTRSZ; i++)
+		if (SUMSTR(art, i) == NULL &&
+		    sumstrs[i] != offsetof(struct article, img))
+			return 0;
+
+	art->titlesz = strlen(art->title);
+	art->titletextsz = strlen(art->titletext);
+	art->asidesz = strlen(art->aside);
+	art->asidetextsz = strlen(art->asidetext);
+	art->authorsz = strlen(art->author);
+	art->authortextsz = strlen(art->authortext);
+
+	if (!sum_num(&fl[i++], LLONG_MIN, LLONG_MAX, &v))
+		return 0;
+	art->time = (time_t)v;
+	if (!sum_num(&fl[i++], 0, 1, &v))
+		return 0;
+	art->isdatetime = (int)v;
+	if (!sum_num(&fl[i++], SORT_DEFAULT, SORT_LAST, &v))
+		return 0;
+	art->sort = (enum sort)v;
+	if (!sum_num(&fl[i++], 0, LLONG_MAX, &v))
+		return 0;
+	art->order = (size_t)v;
+	if (!sum_num(&fl[i++], 0, LLONG_MAX, &v))
+		return 0;
+	*pos = (size_t)v;
+
+	/* Tags are a count followed by the tags. */
+
+	if (!sum_num(&fl[i++], 0, LLONG_MAX, &v) ||
+	    (size_t)v > flsz - i - 1)
+		return 0;
+	n = (size_t)v;
+	if (n > 0)
+		art->tagmap = xcalloc(n, sizeof(char *));
+	for (j = 0; j < n; j++, i++)
+		if ((art->tagmap[art->tagmapsz++] =
+		    sum_str(&fl[i])) == NULL)
+			return 0;
+
+	/* Keys are a count followed by key-value pairs. */
+
+	if (!sum_num(&fl[i++], 0, LLONG_MAX / 2, &v) ||
+	    (size_t)v * 2 != flsz - i)
+		return 0;
+	n = (size_t)v * 2;
+	if (n > 0)
+		art->setmap = xcalloc(n, sizeof(char *));
+	for (j = 0; j < n; j++, i++)
+		if ((art->setmap[art->setmapsz++] =
+		    sum_str(&fl[i])) == NULL)
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Read all articles from the summary file "src" into "arts", which has
+ * "artsz" articles already.
+ * Article bodies are NULL.
+ * If "pos" is not NULL, it's set as in corpus_read().
+ * Return zero on failure, non-zero on success.
+ */
+int
+summary_read(const char *src, struct article **arts, size_t *artsz,
+	size_t **pos)
+{
+	char		*buf = NULL;
+	const char	*cp, *end, *ln, *tab;
+	size_t		 sz = 0, line = 1, flsz, flmax = 0, 
+			 artmax = *artsz, start = *artsz, i, o,
+			*apos = NULL;
+	int		 fd = -1, rc = 0;
+	struct sumfield	*fl = NULL;
+	struct article	*art;
+
+	if (!mmap_open(src, &fd, &buf, &sz))
+		return 0;
+
+	cp = buf;
+	end = buf + sz;
+
+	/* Check the magic and version. */
+
+	ln = memchr(cp, '\n', end - cp);
+	if (ln == NULL ||
+	    (size_t)(ln - cp) <= strlen(SUMMARY_MAGIC) + 1 ||
+	    strncmp(cp, SUMMARY_MAGIC "\t",
+		    strlen(SUMMARY_MAGIC) + 1) != 0) {
+		ctxwarnx("%s: not a summary file", src);
+		goto out;
+	} else if (atoi(cp + strlen(SUMMARY_MAGIC) + 1) !=
+	           SUMMARY_VERSION) {
+		ctxwarnx("%s: unknown summary version", src);
+		goto out;
+	}
+
+	for (cp = ln + 1; cp < end; cp = ln + 1) {
+		line++;
+		if ((ln = memchr(cp, '\n', end - cp)) == NULL)
+			ln = end;
+		if (ln == cp)
+			continue;
+
+		/* Split the line into its fields. */
+
+		for (flsz = 0; ; cp = tab + 1) {
+			if (flsz == flmax) {
+				flmax = flmax == 0 ? 64 : flmax * 2;
+				fl = xreallocarray
+					(fl, flmax, sizeof(struct sumfield));
+			}
+			if ((tab = memchr(cp, '\t', ln - cp)) == NULL)
+				tab = ln;
+			fl[flsz].cp = cp;
+			fl[flsz++].sz = tab - cp;
+			if (tab == ln)
+				break;
+		}
+
+		if (*artsz == artmax) {
+			artmax = artmax < 64 ? 64 : artmax * 2;
+			*arts = xreallocarray
+				(*arts, artmax, sizeof(struct article));
+			apos = xreallocarray(apos, artmax, sizeof(size_t));
+		}
+		art = &(*arts)[*artsz];
+		(*artsz)++;
+		memset(art, 0, sizeof(struct article));
+
+		if (!sum_article(art, &apos[*artsz - 1], fl, flsz)) {
+			ctxwarnx("%s:%zu: malformed summary", src, line);
+			goto out;
+		}
+	}
+
+	/*
+	 * Positions are indexed by order, so each order must be that of
+	 * one article.
+	 */
+
+	if (pos != NULL && *artsz > 0) {
+		*pos = xreallocarray(*pos, *artsz, sizeof(size_t));
+		for (i = 0; i < *artsz; i++)
+			(*pos)[i] = SIZE_MAX;
+		for (i = start; i < *artsz; i++) {
+			o = (*arts)[i].order;
+			if (o >= *artsz || (*pos)[o] != SIZE_MAX) {
+				ctxwarnx("%s: malformed summary "
+					"order", src);
+				goto out;
+			}
+			(*pos)[o] = apos[i];
+		}
+	}
+
+	rc = 1;
+out:
+	free(apos);
+	free(fl);
+	mmap_close(fd, buf, sz);
+	return rc;
+}
+
+/*
+ * Write the sorted summary (article metadata without bodies) of all
+ * articles in "src" into "dst".
+ * Return zero on failure, non-zero on success.
+ */
+int
+summary(XML_Parser p, int sz, char *src[],
+	const char *dst, enum asort asort)
+{
+	size_t		 i, j, sargsz = 0, *pos = NULL;
+	int		 rc = 0;
+	FILE		*f = stdout;
+	struct article	*sargs = NULL;
+	struct input	 in;
+
+	memset(&in, 0, sizeof(struct input));
+
+	if (!corpus_read(p, &in, sz, src,
+	    NULL, GROK_NOBODY, &sargs, &sargsz, &pos))
+		goto out;
+
+	sblg_sort(sargs, sargsz, asort);
+
+	if (strcmp(dst, "-") && (f = fopen(dst, "w")) == NULL) {
+		ctxwarn("%s", dst);
+		goto out;
+	}
+
+	fprintf(f, "%s\t%d\n", SUMMARY_MAGIC, SUMMARY_VERSION);
+
+	for (i = 0; i < sargsz; i++) {
+		for (j = 0; j < SUMSTRSZ; j++) {
+			sum_puts(f, SUMSTR(&sargs[i], j));
+			fputc('\t', f);
+		}
+		fprintf(f, "%lld\t%d\t%d\t%zu\t%zu\t%zu",
+			(long long)sargs[i].time,
+			sargs[i].isdatetime, (int)sargs[i].sort,
+			sargs[i].order, pos[sargs[i].order],
+			sargs[i].tagmapsz);
+		for (j = 0; j < sargs[i].tagmapsz; j++) {
+			fputc('\t', f);
+			sum_puts(f, sargs[i].tagmap[j]);
+		}
+		fprintf(f, "\t%zu", sargs[i].setmapsz / 2);
+		for (j = 0; j < sargs[i].setmapsz; j++) {
+			fputc('\t', f);
+			sum_puts(f, sargs[i].setmap[j]);
+		}
+		fputc('\n', f);
+	}
+
+	rc = 1;
+out:
+	sblg_free(sargs, sargsz);
+	free(pos);
+	if (f != NULL && f != stdout)
+		fclose(f);
+	return rc;
+}
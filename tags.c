@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * FNV-1a.
+ */
+static size_t
+taghash(const char *cp)
+{
+	uint32_t	 h = 2166136261U;
+
+	for ( ; *cp != '\0'; cp++) {
+		h ^= (unsigned char)*cp;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+tagtab_grow(struct tagtab *tab)
+{
+	size_t	 i, j;
+
+	free(tab->slots);
+	tab->slotsz = tab->slotsz == 0 ? 256 : tab->slotsz * 2;
+	tab->slots = xreallocarray(NULL, tab->slotsz, sizeof(size_t));
+	memset(tab->slots, 0xff, tab->slotsz * sizeof(size_t));
+
+	for (i = 0; i < tab->tagsz; i++) {
+		j = taghash(tab->tags[i]) & (tab->slotsz - 1);
+		while (tab->slots[j] != SIZE_MAX)
+			j = (j + 1) & (tab->slotsz - 1);
+		tab->slots[j] = i;
+	}
+}
+
+/*
+ * Look up "tag", setting its number in "id" if found.
+ * Returns zero if not found, non-zero if found.
+ */
+int
+tagtab_find(const struct tagtab *tab, const char *tag, size_t *id)
+{
+	size_t	 j;
+
+	if (tab->slotsz == 0)
+		return 0;
+
+	j = taghash(tag) & (tab->slotsz - 1);
+	for ( ; tab->slots[j] != SIZE_MAX; j = (j + 1) & (tab->slotsz - 1))
+		if (strcmp(tab->tags[tab->slots[j]], tag) == 0) {
+			*id = tab->slots[j];
+			return 1;
+		}
+
+	return 0;
+}
+
+/*
+ * Look up "tag", adding it if not found.
+ * The tag is referenced, not copied.
+ * Returns the number of the tag, which is its order of addition.
+ */
+size_t
+tagtab_get(struct tagtab *tab, const char *tag)
+{
+	size_t	 j;
+
+	if ((tab->tagsz + 1) * 2 > tab->slotsz)
+		tagtab_grow(tab);
+
+	j = taghash(tag) & (tab->slotsz - 1);
+	for ( ; tab->slots[j] != SIZE_MAX; j = (j + 1) & (tab->slotsz - 1))
+		if (strcmp(tab->tags[tab->slots[j]], tag) == 0)
+			return tab->slots[j];
+
+	if (tab->tagsz == tab->tagmax) {
+		tab->tagmax = tab->tagmax == 0 ? 64 : tab->tagmax * 2;
+		tab->tags = xreallocarray
+			(tab->tags, tab->tagmax, sizeof(char *));
+	}
+	tab->tags[tab->tagsz] = tag;
+	tab->slots[j] = tab->tagsz;
+	return tab->tagsz++;
+}
+
+void
+tagtab_free(struct tagtab *tab)
+{
+
+	free(tab->slots);
+	free(tab->tags);
+	memset(tab, 0, sizeof(struct tagtab));
+}
+
+/*
+ * Number the tags of articles "p" in "tab", filling in "ids" with the
+ * numbers of all articles' tags, those of article "i" being from
+ * "off[i]" to "off[i + 1]".
+ * Free "ids" and "off" with free(3).
+ */
+void
+tagtab_ids(struct tagtab *tab, const struct article *p, size_t sz,
+	size_t **ids, size_t **off)
+{
+	size_t	 i, j, n;
+
+	*off = xcalloc(sz + 1, sizeof(size_t));
+	for (n = i = 0; i < sz; i++) {
+		(*off)[i] = n;
+		n += p[i].tagmapsz;
+	}
+	(*off)[sz] = n;
+
+	*ids = xcalloc(n + 1, sizeof(size_t));
+	for (n = i = 0; i < sz; i++)
+		for (j = 0; j < p[i].tagmapsz; j++)
+			(*ids)[n++] = tagtab_get(tab, p[i].tagmap[j]);
+}
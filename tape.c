@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <expat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "extern.h"
+
+/*
+ * A tape is a sequence of records, each starting with its type:
+ *
+ *   TAPE_OPEN   name, attribute count, then for each attribute its
+ *               name, value length, and NUL-terminated value
+ *   TAPE_CLOSE  name
+ *   TAPE_TEXT   length, then the text
+ *
+ * Names and lengths are native uint32_t; names are numbers in the
+ * tape's table of names.
+ */
+#define	TAPE_OPEN	'o'
+#define	TAPE_CLOSE	'c'
+#define	TAPE_TEXT	't'
+
+static void
+tape_grow(struct tape *t, size_t sz)
+{
+
+	if (t->sz + sz <= t->max)
+		return;
+	while (t->sz + sz > t->max)
+		t->max = t->max < 1024 ? 1024 : t->max * 2;
+	t->buf = xrealloc(t->buf, t->max);
+}
+
+static void
+tape_put(struct tape *t, const void *p, size_t sz)
+{
+
+	tape_grow(t, sz);
+	memcpy(t->buf + t->sz, p, sz);
+	t->sz += sz;
+}
+
+static void
+tape_type(struct tape *t, char type)
+{
+
+	tape_grow(t, 1);
+	t->buf[t->sz++] = type;
+}
+
+static void
+tape_u32(struct tape *t, uint32_t v)
+{
+
+	tape_put(t, &v, sizeof(uint32_t));
+}
+
+static uint32_t
+tape_getu32(const char **cp)
+{
+	uint32_t	 v;
+
+	memcpy(&v, *cp, sizeof(uint32_t));
+	*cp += sizeof(uint32_t);
+	return v;
+}
+
+/*
+ * Intern the name "s", returning its number.
+ */
+static uint32_t
+tape_name(struct tape *t, const XML_Char *s)
+{
+	size_t	 id;
+
+	if (!tagtab_find(&t->names, s, &id))
+		id = tagtab_get(&t->names, xstrdup(s));
+	return id;
+}
+
+/*
+ * Record an element opening "s" with attributes "atts".
+ */
+void
+tape_open(struct tape *t, const XML_Char *s, const XML_Char **atts)
+{
+	uint32_t	 n;
+	size_t		 sz;
+
+	for (n = 0; atts[n * 2] != NULL; n++)
+		continue;
+
+	tape_type(t, TAPE_OPEN);
+	tape_u32(t, tape_name(t, s));
+	tape_u32(t, n);
+	for ( ; *atts != NULL; atts += 2) {
+		sz = strlen(atts[1]);
+		tape_u32(t, tape_name(t, atts[0]));
+		tape_u32(t, sz);
+		tape_put(t, atts[1], sz + 1);
+	}
+}
+
+/*
+ * Record an element closing "s".
+ */
+void
+tape_close(struct tape *t, const XML_Char *s)
+{
+
+	tape_type(t, TAPE_CLOSE);
+	tape_u32(t, tape_name(t, s));
+}
+
+/*
+ * Record text "s" of length "len".
+ */
+void
+tape_text(struct tape *t, const XML_Char *s, int len)
+{
+
+	if (len <= 0)
+		return;
+	tape_type(t, TAPE_TEXT);
+	tape_u32(t, len);
+	tape_put(t, s, len);
+}
+
+/*
+ * Append the markup recorded between offsets "start" and "end" to the
+ * NUL-terminated buffer "p" of length "sz", keeping only attributes in
+ * "wl" if not NULL.
+ * If "textonly" is non-zero, only text is appended.
+ */
+void
+tape_replay(struct tape *t, size_t start, size_t end,
+	const struct wlist *wl, int textonly, char **p, size_t *sz)
+{
+	const char	*cp = t->buf + start, *ep = t->buf + end;
+	uint32_t	 name, n, i, len;
+
+	while (cp < ep)
+		switch (*cp++) {
+		case TAPE_OPEN:
+			name = tape_getu32(&cp);
+			n = tape_getu32(&cp);
+			if (t->attsmax < n * 2 + 1) {
+				t->attsmax = n * 2 + 1;
+				t->atts = xreallocarray(t->atts,
+					t->attsmax, sizeof(char *));
+			}
+			for (i = 0; i < n; i++) {
+				t->atts[i * 2] =
+					t->names.tags[tape_getu32(&cp)];
+				len = tape_getu32(&cp);
+				t->atts[i * 2 + 1] = cp;
+				cp += len + 1;
+			}
+			t->atts[n * 2] = NULL;
+			if (!textonly)
+				xmlstropen(p, sz, t->names.tags[name],
+					t->atts, wl);
+			break;
+		case TAPE_CLOSE:
+			name = tape_getu32(&cp);
+			if (!textonly)
+				xmlstrclose(p, sz, t->names.tags[name]);
+			break;
+		default:
+			len = tape_getu32(&cp);
+			xmlstrtext(p, sz, cp, len);
+			cp += len;
+			break;
+		}
+}
+
+void
+tape_free(struct tape *t)
+{
+	size_t	 i;
+
+	for (i = 0; i < t->names.tagsz; i++)
+		free((char *)t->names.tags[i]);
+	tagtab_free(&t->names);
+	free(t->buf);
+	free(t->atts);
+	memset(t, 0, sizeof(struct tape));
+}
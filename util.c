@@ -25,8 +25,9 @@
 #endif
 #include <expat.h>
 #include <fcntl.h>
-#include <search.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,77 +38,83 @@
 #include "version.h"
 
 struct	htab {
-	char		*tabent; /* used in the table entry */
 	const char	*name; /* the static name */
 	enum sblgtag	 tag; /* static tag */
 };
 
-static	int htabinit = 0;
-
-static	struct htab htabs[SBLGTAG_NONE] = {
-	{ NULL, "data-sblg-altlink", SBLG_ATTR_ALTLINK },
-	{ NULL, "data-sblg-altlink-fmt", SBLG_ATTR_ALTLINKFMT },
-	{ NULL, "data-sblg-article", SBLG_ATTR_ARTICLE },
-	{ NULL, "data-sblg-articletag", SBLG_ATTR_ARTICLETAG },
-	{ NULL, "data-sblg-aside", SBLG_ATTR_ASIDE },
-	{ NULL, "data-sblg-atomcontent", SBLG_ATTR_ATOMCONTENT },
-	{ NULL, "data-sblg-author", SBLG_ATTR_AUTHOR },
-	{ NULL, "data-sblg-const-aside", SBLG_ATTR_CONST_ASIDE },
-	{ NULL, "data-sblg-const-author", SBLG_ATTR_CONST_AUTHOR },
-	{ NULL, "data-sblg-const-datetime", SBLG_ATTR_CONST_DATETIME },
-	{ NULL, "data-sblg-const-img", SBLG_ATTR_CONST_IMG },
-	{ NULL, "data-sblg-const-title", SBLG_ATTR_CONST_TITLE },
-	{ NULL, "data-sblg-content", SBLG_ATTR_CONTENT },
-	{ NULL, "data-sblg-datetime", SBLG_ATTR_DATETIME },
-	{ NULL, "data-sblg-entry", SBLG_ATTR_ENTRY },
-	{ NULL, "data-sblg-forall", SBLG_ATTR_FORALL },
-	{ NULL, "data-sblg-ign-once", SBLG_ATTR_IGN_ONCE },
-	{ NULL, "data-sblg-img", SBLG_ATTR_IMG },
-	{ NULL, "data-sblg-lang", SBLG_ATTR_LANG },
-	{ NULL, "data-sblg-nav", SBLG_ATTR_NAV },
-	{ NULL, "data-sblg-navcontent", SBLG_ATTR_NAVCONTENT }, /* DEPRECATED */
-	{ NULL, "data-sblg-navsort", SBLG_ATTR_NAVSORT },
-	{ NULL, "data-sblg-navstart", SBLG_ATTR_NAVSTART },
-	{ NULL, "data-sblg-navstyle-content", SBLG_ATTR_NAVSTYLE_CONTENT },
-	{ NULL, "data-sblg-navstyle-element", SBLG_ATTR_NAVSTYLE_ELEMENT },
-	{ NULL, "data-sblg-navsz", SBLG_ATTR_NAVSZ },
-	{ NULL, "data-sblg-navtag", SBLG_ATTR_NAVTAG },
-	{ NULL, "data-sblg-navxml", SBLG_ATTR_NAVXML }, /* DEPRECATED */
-	{ NULL, "data-sblg-permlink", SBLG_ATTR_PERMLINK },
-	{ NULL, "data-sblg-sort", SBLG_ATTR_SORT },
-	{ NULL, "data-sblg-source", SBLG_ATTR_SOURCE },
-	{ NULL, "data-sblg-striplink", SBLG_ATTR_STRIPLINK },
-	{ NULL, "data-sblg-tags", SBLG_ATTR_TAGS },
-	{ NULL, "data-sblg-title", SBLG_ATTR_TITLE },
-	{ NULL, "address", SBLG_ELEM_ADDRESS },
-	{ NULL, "area", SBLG_ELEM_AREA },
-	{ NULL, "article", SBLG_ELEM_ARTICLE },
-	{ NULL, "aside", SBLG_ELEM_ASIDE },
-	{ NULL, "base", SBLG_ELEM_BASE },
-	{ NULL, "br", SBLG_ELEM_BR },
-	{ NULL, "col", SBLG_ELEM_COL },
-	{ NULL, "command", SBLG_ELEM_COMMAND },
-	{ NULL, "embed", SBLG_ELEM_EMBED },
-	{ NULL, "entry", SBLG_ELEM_ENTRY },
-	{ NULL, "h1", SBLG_ELEM_H1 },
-	{ NULL, "h2", SBLG_ELEM_H2 },
-	{ NULL, "h3", SBLG_ELEM_H3 },
-	{ NULL, "h4", SBLG_ELEM_H4 },
-	{ NULL, "hr", SBLG_ELEM_HR },
-	{ NULL, "id", SBLG_ELEM_ID },
-	{ NULL, "img", SBLG_ELEM_IMG },
-	{ NULL, "input", SBLG_ELEM_INPUT },
-	{ NULL, "keygen", SBLG_ELEM_KEYGEN },
-	{ NULL, "link", SBLG_ELEM_LINK },
-	{ NULL, "meta", SBLG_ELEM_META },
-	{ NULL, "nav", SBLG_ELEM_NAV },
-	{ NULL, "param", SBLG_ELEM_PARAM },
-	{ NULL, "source", SBLG_ELEM_SOURCE },
-	{ NULL, "time", SBLG_ELEM_TIME },
-	{ NULL, "title", SBLG_ELEM_TITLE },
-	{ NULL, "track", SBLG_ELEM_TRACK },
-	{ NULL, "updated", SBLG_ELEM_UPDATED },
-	{ NULL, "wbr", SBLG_ELEM_WBR },
+/*
+ * Slots of the open-addressed table of names in htabs, built once and
+ * only read thereafter, so lookups need no locking.
+ */
+#define	HTAB_SLOTS	 256
+
+static	pthread_once_t htabonce = PTHREAD_ONCE_INIT;
+static	const struct htab *htabslots[HTAB_SLOTS];
+
+static	const struct htab htabs[SBLGTAG_NONE] = {
+	{ "data-sblg-altlink", SBLG_ATTR_ALTLINK },
+	{ "data-sblg-altlink-fmt", SBLG_ATTR_ALTLINKFMT },
+	{ "data-sblg-article", SBLG_ATTR_ARTICLE },
+	{ "data-sblg-articletag", SBLG_ATTR_ARTICLETAG },
+	{ "data-sblg-aside", SBLG_ATTR_ASIDE },
+	{ "data-sblg-atomcontent", SBLG_ATTR_ATOMCONTENT },
+	{ "data-sblg-author", SBLG_ATTR_AUTHOR },
+	{ "data-sblg-const-aside", SBLG_ATTR_CONST_ASIDE },
+	{ "data-sblg-const-author", SBLG_ATTR_CONST_AUTHOR },
+	{ "data-sblg-const-datetime", SBLG_ATTR_CONST_DATETIME },
+	{ "data-sblg-const-img", SBLG_ATTR_CONST_IMG },
+	{ "data-sblg-const-title", SBLG_ATTR_CONST_TITLE },
+	{ "data-sblg-content", SBLG_ATTR_CONTENT },
+	{ "data-sblg-datetime", SBLG_ATTR_DATETIME },
+	{ "data-sblg-entry", SBLG_ATTR_ENTRY },
+	{ "data-sblg-forall", SBLG_ATTR_FORALL },
+	{ "data-sblg-ign-once", SBLG_ATTR_IGN_ONCE },
+	{ "data-sblg-img", SBLG_ATTR_IMG },
+	{ "data-sblg-lang", SBLG_ATTR_LANG },
+	{ "data-sblg-nav", SBLG_ATTR_NAV },
+	{ "data-sblg-navcontent", SBLG_ATTR_NAVCONTENT }, /* DEPRECATED */
+	{ "data-sblg-navsort", SBLG_ATTR_NAVSORT },
+	{ "data-sblg-navstart", SBLG_ATTR_NAVSTART },
+	{ "data-sblg-navstyle-content", SBLG_ATTR_NAVSTYLE_CONTENT },
+	{ "data-sblg-navstyle-element", SBLG_ATTR_NAVSTYLE_ELEMENT },
+	{ "data-sblg-navsz", SBLG_ATTR_NAVSZ },
+	{ "data-sblg-navtag", SBLG_ATTR_NAVTAG },
+	{ "data-sblg-navxml", SBLG_ATTR_NAVXML }, /* DEPRECATED */
+	{ "data-sblg-permlink", SBLG_ATTR_PERMLINK },
+	{ "data-sblg-sort", SBLG_ATTR_SORT },
+	{ "data-sblg-source", SBLG_ATTR_SOURCE },
+	{ "data-sblg-striplink", SBLG_ATTR_STRIPLINK },
+	{ "data-sblg-tags", SBLG_ATTR_TAGS },
+	{ "data-sblg-title", SBLG_ATTR_TITLE },
+	{ "address", SBLG_ELEM_ADDRESS },
+	{ "area", SBLG_ELEM_AREA },
+	{ "article", SBLG_ELEM_ARTICLE },
+	{ "aside", SBLG_ELEM_ASIDE },
+	{ "base", SBLG_ELEM_BASE },
+	{ "br", SBLG_ELEM_BR },
+	{ "col", SBLG_ELEM_COL },
+	{ "command", SBLG_ELEM_COMMAND },
+	{ "embed", SBLG_ELEM_EMBED },
+	{ "entry", SBLG_ELEM_ENTRY },
+	{ "h1", SBLG_ELEM_H1 },
+	{ "h2", SBLG_ELEM_H2 },
+	{ "h3", SBLG_ELEM_H3 },
+	{ "h4", SBLG_ELEM_H4 },
+	{ "hr", SBLG_ELEM_HR },
+	{ "id", SBLG_ELEM_ID },
+	{ "img", SBLG_ELEM_IMG },
+	{ "input", SBLG_ELEM_INPUT },
+	{ "keygen", SBLG_ELEM_KEYGEN },
+	{ "link", SBLG_ELEM_LINK },
+	{ "meta", SBLG_ELEM_META },
+	{ "nav", SBLG_ELEM_NAV },
+	{ "param", SBLG_ELEM_PARAM },
+	{ "source", SBLG_ELEM_SOURCE },
+	{ "time", SBLG_ELEM_TIME },
+	{ "title", SBLG_ELEM_TITLE },
+	{ "track", SBLG_ELEM_TRACK },
+	{ "updated", SBLG_ELEM_UPDATED },
+	{ "wbr", SBLG_ELEM_WBR },
 };
 
 /*
@@ -156,31 +163,94 @@ htmlvoid(const XML_Char *s)
 	return 0;
 }
 
+static int
+wlistcmp(const void *p1, const void *p2)
+{
+	const char	*s1 = *(const char **)p1,
+	     		*s2 = *(const char **)p2;
+	size_t		 sz1 = strlen(s1), sz2 = strlen(s2);
+
+	if (sz1 != sz2)
+		return sz1 < sz2 ? -1 : 1;
+	return strcasecmp(s1, s2);
+}
+
 /*
- * Look up the given HTML5 attribute in a whitelist.
+ * Compile the NULL-terminated list of attribute names "names" for
+ * wlist_find().
+ * The names are referenced, not copied.
+ * Free with wlist_free().
+ */
+void
+wlist_init(struct wlist *wl, const char **names)
+{
+	size_t	 i, n, len;
+
+	memset(wl, 0, sizeof(struct wlist));
+
+	for (n = 0; names[n] != NULL; n++)
+		if ((len = strlen(names[n])) > wl->maxlen)
+			wl->maxlen = len;
+
+	wl->names = xcalloc(n + 1, sizeof(char *));
+	memcpy(wl->names, names, n * sizeof(char *));
+	qsort(wl->names, n, sizeof(char *), wlistcmp);
+
+	/* lens[len] is the first name at least "len" long. */
+
+	wl->lens = xcalloc(wl->maxlen + 2, sizeof(size_t));
+	for (i = 0, len = 0; len <= wl->maxlen + 1; len++) {
+		while (i < n && strlen(wl->names[i]) < len)
+			i++;
+		wl->lens[len] = i;
+	}
+}
+
+void
+wlist_free(struct wlist *wl)
+{
+
+	free(wl->names);
+	free(wl->lens);
+}
+
+/*
+ * Look up the given HTML5 attribute in a white-list.
+ * This only searches names of the same length, so it doesn't allocate
+ * or scan the whole list.
  * Returns zero on failure, non-zero on found.
  */
-static int
-htmlwhitelist(const XML_Char *s, const char **wl)
+int
+wlist_find(const struct wlist *wl, const char *s)
 {
-	const char	**cp;
+	size_t	 len, lo, hi, mid;
+	int	 c;
 
-	for (cp = wl; *cp != NULL; cp++) 
-		if (strcasecmp(s, *cp) == 0)
-			return 1;
+	if ((len = strlen(s)) > wl->maxlen)
+		return 0;
 
+	lo = wl->lens[len];
+	hi = wl->lens[len + 1];
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((c = strcasecmp(s, wl->names[mid])) == 0)
+			return 1;
+		if (c < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
 	return 0;
 }
 
 /*
- * Map a regular file into memory for parsing.
- * Make sure it's not too large, first.
+ * Open "f" and, if "stream" is zero or it's a regular file small enough
+ * for expat's buffer, map it into memory.
  * Return zero on failure, non-zero on success.
- * On success, symmetrise with mmap_close().
- * Failure need not call mmap_close().
+ * On success, "buf" is NULL if "f" is to be read from "fd" instead.
  */
-int
-mmap_open(const char *f, int *fd, char **buf, size_t *sz)
+static int
+mmap_stream(const char *f, int stream, int *fd, char **buf, size_t *sz)
 {
 	struct stat	 st;
 
@@ -189,16 +259,22 @@ mmap_open(const char *f, int *fd, char **buf, size_t *sz)
 	*sz = 0;
 
 	if ((*fd = open(f, O_RDONLY, 0)) == -1) {
-		warn("%s", f);
+		ctxwarn("%s", f);
 		goto out;
 	} else if (fstat(*fd, &st) == -1) {
-		warn("%s", f);
+		ctxwarn("%s", f);
 		goto out;
-	} else if (!S_ISREG(st.st_mode)) {
-		warnx("%s: not a regular file", f);
+	}
+
+	if (stream && (!S_ISREG(st.st_mode) || 
+	    st.st_size == 0 || st.st_size >= (1U << 31)))
+		return 1;
+
+	if (!S_ISREG(st.st_mode)) {
+		ctxwarnx("%s: not a regular file", f);
 		goto out;
 	} else if (st.st_size >= (1U << 31)) {
-		warnx("%s: too large", f);
+		ctxwarnx("%s: too large", f);
 		goto out;
 	}
 
@@ -206,16 +282,49 @@ mmap_open(const char *f, int *fd, char **buf, size_t *sz)
 	*buf = mmap(NULL, *sz, PROT_READ, MAP_SHARED, *fd, 0);
 
 	if (*buf == MAP_FAILED) {
-		warn("%s", f);
+		ctxwarn("%s", f);
 		goto out;
 	}
 
+	/* We read it all, in order: don't fault it in page by page. */
+
+#ifdef MADV_WILLNEED
+	(void)madvise(*buf, *sz, MADV_SEQUENTIAL);
+	(void)madvise(*buf, *sz, MADV_WILLNEED);
+#endif
 	return 1;
 out:
 	mmap_close(*fd, *buf, *sz);
 	return 0;
 }
 
+/*
+ * Map a regular file into memory for parsing.
+ * Make sure it's not too large, first.
+ * Return zero on failure, non-zero on success.
+ * On success, symmetrise with mmap_close().
+ * Failure need not call mmap_close().
+ */
+int
+mmap_open(const char *f, int *fd, char **buf, size_t *sz)
+{
+
+	return mmap_stream(f, 0, fd, buf, sz);
+}
+
+/*
+ * Like mmap_open(), but files that can't be mapped whole (pipes, empty
+ * files, or files too large for expat's buffer) are left open in "fd"
+ * with "buf" set to NULL, to be read in chunks instead.
+ * Return zero on failure, non-zero on success.
+ */
+int
+mmap_or_stream(const char *f, int *fd, char **buf, size_t *sz)
+{
+
+	return mmap_stream(f, 1, fd, buf, sz);
+}
+
 /*
  * Reverse of mmap_open, though can be called with NULL/invalid.
  * Do NOT call twice.
@@ -230,6 +339,37 @@ mmap_close(int fd, void *buf, size_t sz)
 		close(fd);
 }
 
+/*
+ * Default output name for the article source "src": without any
+ * compression suffix, then with ".xml" or ".md" replaced by ".html"
+ * or, failing that, ".html" appended.
+ * Must be freed by the caller.
+ */
+char *
+html_name(const char *src)
+{
+	char	*name, *cp;
+	size_t	 sz;
+
+	name = zread_name(src);
+	sz = strlen(name);
+	if ((cp = strrchr(name, '.')) != NULL &&
+	    strcasecmp(cp + 1, "xml") == 0) {
+		/* Replace .xml with .html. */
+		name = xrealloc(name, sz + 2);
+		strlcpy(name + sz - 3, "html", 5);
+	} else if (cp != NULL && strcasecmp(cp + 1, "md") == 0) {
+		/* Replace .md with .html. */
+		name = xrealloc(name, sz + 3);
+		strlcpy(name + sz - 2, "html", 5);
+	} else {
+		/* Append .html to input name. */
+		name = xrealloc(name, sz + 6);
+		strlcat(name, ".html", sz + 6);
+	}
+	return name;
+}
+
 /*
  * Whether an XML attribute value evaluates to Boolean true.
  * Return zero on false, non-zero on true.
@@ -268,17 +408,18 @@ xmlstrtext(char **p, size_t *sz, const XML_Char *s, int len)
 void
 xmlstrclose(char **p, size_t *sz, const XML_Char *name)
 {
-	size_t	 ssz;
+	size_t	 ssz, nsz;
 
 	if (htmlvoid(name))
 		return;
 
-	ssz = strlen(name) + 3;
-	*sz += ssz;
+	nsz = strlen(name);
+	ssz = *sz;
+	*sz += nsz + 3;
 	*p = xrealloc(*p, *sz + 1);
-	strlcat(*p, "</", *sz + 1);
-	strlcat(*p, name, *sz + 1);
-	strlcat(*p, ">", *sz + 1);
+	memcpy(*p + ssz, "</", 2);
+	memcpy(*p + ssz + 2, name, nsz);
+	memcpy(*p + ssz + 2 + nsz, ">", 2);
 }
 
 /*
@@ -332,87 +473,86 @@ xmlstrescapesz(const char *cp)
 }
 
 /*
- * Like xmlescape(), but serialising into a string.
- * The buffer must be preallocated like with xmlstrescapesz().
+ * Like xmlescape(), but serialising into a string "p" preallocated as
+ * with xmlstrescapesz().
+ * Returns the position after the escaped string (not NUL-terminated).
  * FIXME: use strcspn().
  */
-static void
-xmlstrescape(char *p, size_t sz, const char *cp)
+static char *
+xmlstrescape(char *p, const char *cp)
 {
-	size_t	ssz;
-
-	ssz = strlen(p);
 
 	for ( ; *cp != '\0'; cp++) 
 		switch (*cp) {
 		case '"':
-			ssz = strlcat(p, "&quot;", sz);
+			memcpy(p, "&quot;", 6);
+			p += 6;
 			break;
 		case '&':
-			ssz = strlcat(p, "&amp;", sz);
+			memcpy(p, "&amp;", 5);
+			p += 5;
 			break;
 		default:
-			p[ssz++] = *cp;
-			p[ssz] = '\0';
+			*p++ = *cp;
 			break;
 		}
+
+	return p;
 }
 
 /*
  * Append the XML element "name" opening to the buffer in "p", which is
  * always NUL terminated and of length "sz".
  * If the element is an XML void element, it is auto-closed.
- * If the white-list is not NULL, it is scanned and only attributes in
- * the white-list are serialised.
+ * If the white-list is not NULL, only attributes in the white-list are
+ * serialised.
+ * The buffer is grown once for the whole element.
  */
 void
 xmlstropen(char **p, size_t *sz, const XML_Char *name,
-	const XML_Char **atts, const char **whitelist)
+	const XML_Char **atts, const struct wlist *wl)
 {
-	size_t	 ssz;
+	size_t	 ssz, nsz, i;
 	int	 isvoid;
+	char	*cp;
 
 	isvoid = htmlvoid(name);
+	nsz = strlen(name);
 
-	ssz = strlen(name) + 2 + isvoid;
-	*sz += ssz;
+	/* Size the element: name="value" for each attribute. */
 
-	/* Make sure we zero the initial buffer. */
+	ssz = nsz + 2 + isvoid;
+	for (i = 0; atts[i] != NULL; i += 2)
+		if (wl == NULL || wlist_find(wl, atts[i]))
+			ssz += strlen(atts[i]) + 4 + 
+				xmlstrescapesz(atts[i + 1]);
 
-	*p = (*p == NULL) ?
-		xcalloc(*sz + 1, 1) : xrealloc(*p, *sz + 1);
+	cp = *p = xrealloc(*p, *sz + ssz + 1);
+	cp += *sz;
+	*sz += ssz;
 
-	strlcat(*p, "<", *sz + 1);
-	strlcat(*p, name, *sz + 1);
+	*cp++ = '<';
+	memcpy(cp, name, nsz);
+	cp += nsz;
 
-	for ( ; *atts != NULL; atts += 2) {
-		if (whitelist != NULL &&
-		    !htmlwhitelist(atts[0], whitelist))
+	for (i = 0; atts[i] != NULL; i += 2) {
+		if (wl != NULL && !wlist_find(wl, atts[i]))
 			continue;
-		ssz = strlen(atts[0]) + 2;
-		*sz += ssz;
-		*p = xrealloc(*p, *sz + 1);
-		strlcat(*p, " ", *sz + 1);
-		strlcat(*p, atts[0], *sz + 1);
-		strlcat(*p, "=", *sz + 1);
-
-		/* 
-		 * Remember to buffer in '&quot;' space. 
-		 * Use enough as if each word were that.
-		 * FIXME: this is totally unnecessary.
-		 */
-
-		ssz = xmlstrescapesz(atts[1]) + 2;
-		*sz += ssz;
-		*p = xrealloc(*p, *sz + 1);
-		strlcat(*p, "\"", *sz + 1);
-		xmlstrescape(*p, *sz + 1, atts[1]);
-		strlcat(*p, "\"", *sz + 1);
+		*cp++ = ' ';
+		nsz = strlen(atts[i]);
+		memcpy(cp, atts[i], nsz);
+		cp += nsz;
+		*cp++ = '=';
+		*cp++ = '"';
+		cp = xmlstrescape(cp, atts[i + 1]);
+		*cp++ = '"';
 	}
 
 	if (isvoid)
-		strlcat(*p, "/", *sz + 1);
-	strlcat(*p, ">", *sz + 1);
+		*cp++ = '/';
+	*cp++ = '>';
+	*cp = '\0';
+	assert(cp == *p + *sz);
 }
 
 /*
@@ -610,6 +750,7 @@ xmltextx(FILE *f, const XML_Char *s, const char *url,
 	const char	*cp, *start, *end, *arg, *bufp;
 	char		 buf[32];
 	size_t		 sz, next, prev, argsz, i, asz;
+	struct tm	 tm;
 
 	assert(realsz > 0);
 
@@ -655,16 +796,16 @@ xmltextx(FILE *f, const XML_Char *s, const char *url,
 
 		if (STRCMP("sblg-date", 9)) {
 			strftime(buf, sizeof(buf), "%Y-%m-%d", 
-				gmtime(&arts[artpos].time));
+				gmtime_r(&arts[artpos].time, &tm));
 			bufp = buf;
 		} else if (STRCMP("sblg-datetime", 13)) {
 			strftime(buf, sizeof(buf), "%Y-%m-%dT%TZ", 
-				gmtime(&arts[artpos].time));
+				gmtime_r(&arts[artpos].time, &tm));
 			bufp = buf;
 		} else if (STRCMP("sblg-datetime-fmt", 17)) {
 			fmttime(buf, sizeof(buf), arg, argsz,
 				arts[artpos].isdatetime,
-				localtime(&arts[artpos].time));
+				localtime_r(&arts[artpos].time, &tm));
 			bufp = buf;
 		} else if (STRCMP("sblg-get", 8) ||
 			   STRCMP("sblg-get-escaped", 16) ||
@@ -859,7 +1000,7 @@ xmlopens(FILE *f, const XML_Char *s, const XML_Char **atts)
 
 /*
  * Wrapper for strndup(3).
- * Exits on memory allocation failure.
+ * Calls ctxoom() on memory allocation failure.
  */
 char *
 xstrndup(const char *cp, size_t sz)
@@ -867,13 +1008,13 @@ xstrndup(const char *cp, size_t sz)
 	void	*p;
 
 	if ((p = strndup(cp, sz)) == NULL)
-		err(EXIT_FAILURE, NULL);
+		ctxoom();
 	return p;
 }
 
 /*
  * Wrapper for strdup(3).
- * Exits on memory allocation failure.
+ * Calls ctxoom() on memory allocation failure.
  */
 char *
 xstrdup(const char *cp)
@@ -881,13 +1022,13 @@ xstrdup(const char *cp)
 	void	*p;
 
 	if ((p = strdup(cp)) == NULL)
-		err(EXIT_FAILURE, NULL);
+		ctxoom();
 	return p;
 }
 
 /*
  * Wrapper for reallocarray(3).
- * Exits on memory allocation failure.
+ * Calls ctxoom() on memory allocation failure.
  */
 void *
 xreallocarray(void *cp, size_t nm, size_t sz)
@@ -895,13 +1036,13 @@ xreallocarray(void *cp, size_t nm, size_t sz)
 	void	*p;
 
 	if ((p = reallocarray(cp, nm, sz)) == NULL)
-		err(EXIT_FAILURE, NULL);
+		ctxoom();
 	return p;
 }
 
 /*
  * Wrapper for realloc(3).
- * Exits on memory allocation failure.
+ * Calls ctxoom() on memory allocation failure.
  */
 void *
 xrealloc(void *cp, size_t sz)
@@ -909,13 +1050,13 @@ xrealloc(void *cp, size_t sz)
 	void	*p;
 
 	if ((p = realloc(cp, sz)) == NULL)
-		err(EXIT_FAILURE, NULL);
+		ctxoom();
 	return p;
 }
 
 /*
  * Wrapper for calloc(3).
- * Exits on memory allocation failure.
+ * Calls ctxoom() on memory allocation failure.
  */
 void *
 xcalloc(size_t nm, size_t sz)
@@ -923,13 +1064,13 @@ xcalloc(size_t nm, size_t sz)
 	void	*p;
 
 	if ((p = calloc(nm, sz)) == NULL)
-		err(EXIT_FAILURE, NULL);
+		ctxoom();
 	return p;
 }
 
 /*
  * Wrapper for malloc(3).
- * Exits on memory allocation failure.
+ * Calls ctxoom() on memory allocation failure.
  */
 void *
 xmalloc(size_t sz)
@@ -937,10 +1078,27 @@ xmalloc(size_t sz)
 	void	*p;
 
 	if ((p = malloc(sz)) == NULL)
-		err(EXIT_FAILURE, NULL);
+		ctxoom();
 	return p;
 }
 
+/*
+ * Wrapper for asprintf(3).
+ * Calls ctxoom() on memory allocation failure.
+ */
+void
+xasprintf(char **p, const char *fmt, ...)
+{
+	va_list	 ap;
+	int	 rc;
+
+	va_start(ap, fmt);
+	rc = vasprintf(p, fmt, ap);
+	va_end(ap);
+	if (rc == -1)
+		ctxoom();
+}
+
 /*
  * Break apart "in" into navigation tags "map" of size "in".
  * The input is a string of space-separated except for those with
@@ -953,7 +1111,6 @@ hashtag(char ***map, size_t *sz, const char *in,
 {
 	char	*start, *end, *cur, *tofree, *astart, *aend;
 	size_t	 i;
-	int	 rc;
 
 	if (in[0] == '\0')
 		return;
@@ -1015,15 +1172,13 @@ hashtag(char ***map, size_t *sz, const char *in,
 		for (i = 0; i < arts[artpos].setmapsz; i += 2) {
 			if (strcmp(arts[artpos].setmap[i], astart))
 				continue;
-			rc = asprintf(&(*map)[*sz], "%s%s%s", start,
+			xasprintf(&(*map)[*sz], "%s%s%s", start,
 				arts[artpos].setmap[i + 1], aend);
-			if (rc < 0)
-				err(EXIT_FAILURE, NULL);
 			break;
 		}
 
 		if (i == arts[artpos].setmapsz)
-			asprintf(&(*map)[*sz], "%s%s", start, aend);
+			xasprintf(&(*map)[*sz], "%s%s", start, aend);
 
 		(*sz)++;
 	}
@@ -1031,65 +1186,63 @@ hashtag(char ***map, size_t *sz, const char *in,
 	free(tofree);
 }
 
+static uint32_t
+htab_hash(const char *s)
+{
+	uint32_t	 h = 2166136261U;
+
+	for ( ; *s != '\0'; s++)
+		h = (h ^ (unsigned char)*s) * 16777619U;
+	return h;
+}
+
+static void
+htab_build(void)
+{
+	size_t	 i, j;
+
+	for (i = 0; i < SBLGTAG_NONE; i++) {
+		j = htab_hash(htabs[i].name) & (HTAB_SLOTS - 1);
+		while (htabslots[j] != NULL)
+			j = (j + 1) & (HTAB_SLOTS - 1);
+		htabslots[j] = &htabs[i];
+	}
+}
+
 /*
  * Initialise the hashtable used by sblg to look up attributes.
  * This speeds up the system because we need to look at each attribute
  * to see whether it's one of those we recognise.
+ * The table is shared and built only once, so this may be called any
+ * number of times from any thread.
  */
 int
 sblg_init(void)
 {
-	ENTRY	 hent;
-	ENTRY	*hentp;
-	size_t	 i;
-
-	assert(!htabinit);
-
-	if (!hcreate(256))
-		return 0;
 
-	for (i = 0; i < SBLGTAG_NONE; i++) {
-		htabs[i].tabent = xstrdup(htabs[i].name);
-		hent.key = htabs[i].tabent;
-		hent.data = (void *)&htabs[i].tag;
-		if ((hentp = hsearch(hent, ENTER)) == NULL) {
-			sblg_destroy();
-			return 0;
-		}
-		assert(hentp->key == hent.key);
-	}
-
-	htabinit = 1;
-	return 1;
+	return pthread_once(&htabonce, htab_build) == 0;
 }
 
+/*
+ * Kept for compatibility: the table is never freed.
+ */
 void
 sblg_destroy(void)
 {
-#ifdef	__linux__
-	size_t	 i;
 
-	for (i = 0; i < SBLGTAG_NONE; i++) {
-		free(htabs[i].tabent);
-		htabs[i].tabent = NULL;
-	}
-#endif
-	if (!htabinit)
-		return;
-	hdestroy();
-	htabinit = 0;
 }
 
 enum sblgtag
 sblg_lookup(const char *attr)
 {
-	ENTRY	 hent;
-	ENTRY	*hentp;
-
-	hent.key = (char *)attr;
-	hent.data = NULL;
-	if ((hentp = hsearch(hent, FIND)) == NULL)
-		return SBLGTAG_NONE;
-
-	return *(enum sblgtag *)hentp->data;
+	const struct htab	*h;
+	size_t			 j;
+
+	j = htab_hash(attr) & (HTAB_SLOTS - 1);
+	while ((h = htabslots[j]) != NULL) {
+		if (strcmp(h->name, attr) == 0)
+			return h->tag;
+		j = (j + 1) & (HTAB_SLOTS - 1);
+	}
+	return SBLGTAG_NONE;
 }
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <expat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if HAVE_ZLIB
+# include <zlib.h>
+#endif
+#if HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+#include "extern.h"
+
+/*
+ * Size of reads from the underlying file.
+ */
+#define	ZREAD_CHUNK	 (64 * 1024)
+
+/*
+ * Suffixes of compressed files, stripped from names.
+ */
+static	const char *const zsuffixes[] = {
+	".gz",
+	".zst",
+	NULL
+};
+
+/*
+ * Fill the input buffer from the file if it's been consumed.
+ * Return zero on failure, non-zero on success (including at the end of
+ * the file, with "eof" set).
+ */
+static int
+zread_fill(struct zread *z)
+{
+	ssize_t	 ssz;
+
+	if (z->inoff < z->insz || z->eof)
+		return 1;
+	while ((ssz = read(z->fd, z->in, ZREAD_CHUNK)) == -1 &&
+	    errno == EINTR)
+		continue;
+	if (ssz == -1) {
+		ctxwarn("%s", z->src);
+		return 0;
+	}
+	z->inoff = 0;
+	z->insz = ssz;
+	z->eof = ssz == 0;
+	return 1;
+}
+
+/*
+ * Start reading "src" from "fd", which must be at its start.
+ * Compressed contents are recognised by their magic numbers and
+ * decompressed when read.
+ * Return zero on failure, non-zero on success.
+ * Either way, free with zread_free().
+ */
+int
+zread_init(struct zread *z, const char *src, int fd)
+{
+	const unsigned char	*cp;
+
+	memset(z, 0, sizeof(struct zread));
+	z->fd = fd;
+	z->src = src;
+	z->in = xmalloc(ZREAD_CHUNK);
+	if (!zread_fill(z))
+		return 0;
+
+	cp = (const unsigned char *)z->in;
+	if (z->insz >= 2 && cp[0] == 0x1f && cp[1] == 0x8b) {
+#if HAVE_ZLIB
+		/* Expect a gzip header. */
+		z->type = ZREAD_GZIP;
+		z->dec = xcalloc(1, sizeof(z_stream));
+		if (inflateInit2(z->dec, 16 + MAX_WBITS) != Z_OK) {
+			ctxwarnx("%s: inflateInit2", src);
+			return 0;
+		}
+		return 1;
+#else
+		ctxwarnx("%s: gzip support not compiled in", src);
+		return 0;
+#endif
+	}
+	if (z->insz >= 4 && cp[0] == 0x28 && cp[1] == 0xb5 &&
+	    cp[2] == 0x2f && cp[3] == 0xfd) {
+#if HAVE_ZSTD
+		if ((z->dec = ZSTD_createDStream()) == NULL) {
+			ctxwarnx("%s: ZSTD_createDStream", src);
+			return 0;
+		}
+		z->type = ZREAD_ZSTD;
+		return 1;
+#else
+		ctxwarnx("%s: zstd support not compiled in", src);
+		return 0;
+#endif
+	}
+	z->type = ZREAD_PLAIN;
+	return 1;
+}
+
+#if HAVE_ZLIB
+static ssize_t
+zread_gzip(struct zread *z, char *buf, size_t sz)
+{
+	z_stream	*gz = z->dec;
+	int		 c;
+
+	gz->next_out = (Bytef *)buf;
+	gz->avail_out = sz;
+	while (gz->avail_out > 0 && !z->done) {
+		if (!zread_fill(z))
+			return -1;
+		if (z->eof) {
+			ctxwarnx("%s: truncated gzip stream", z->src);
+			return -1;
+		}
+		gz->next_in = (Bytef *)z->in + z->inoff;
+		gz->avail_in = z->insz - z->inoff;
+		c = inflate(gz, Z_NO_FLUSH);
+		z->inoff = z->insz - gz->avail_in;
+		if (c == Z_STREAM_END) {
+			/* Concatenated members continue the stream. */
+			if (!zread_fill(z))
+				return -1;
+			if (z->eof)
+				z->done = 1;
+			else if (inflateReset(gz) != Z_OK) {
+				ctxwarnx("%s: inflateReset", z->src);
+				return -1;
+			}
+		} else if (c != Z_OK && c != Z_BUF_ERROR) {
+			ctxwarnx("%s: %s", z->src, gz->msg != NULL ?
+				gz->msg : "gzip error");
+			return -1;
+		}
+	}
+	return sz - gz->avail_out;
+}
+#endif
+
+#if HAVE_ZSTD
+static ssize_t
+zread_zstd(struct zread *z, char *buf, size_t sz)
+{
+	ZSTD_inBuffer	 in;
+	ZSTD_outBuffer	 out;
+	size_t		 c;
+
+	out.dst = buf;
+	out.size = sz;
+	out.pos = 0;
+	while (out.pos < out.size && !z->done) {
+		if (!zread_fill(z))
+			return -1;
+		if (z->eof) {
+			if (z->decleft == 0) {
+				z->done = 1;
+				break;
+			}
+			ctxwarnx("%s: truncated zstd stream", z->src);
+			return -1;
+		}
+		in.src = z->in;
+		in.size = z->insz;
+		in.pos = z->inoff;
+		c = ZSTD_decompressStream(z->dec, &out, &in);
+		z->inoff = in.pos;
+		if (ZSTD_isError(c)) {
+			ctxwarnx("%s: %s", z->src, ZSTD_getErrorName(c));
+			return -1;
+		}
+		z->decleft = c;
+	}
+	return out.pos;
+}
+#endif
+
+/*
+ * Read up to "sz" decompressed bytes into "buf".
+ * Returns the number of bytes read, which is only short at the end of
+ * the file, or -1 on failure.
+ */
+ssize_t
+zread(struct zread *z, char *buf, size_t sz)
+{
+	size_t	 i = 0, n;
+
+	switch (z->type) {
+#if HAVE_ZLIB
+	case ZREAD_GZIP:
+		return zread_gzip(z, buf, sz);
+#endif
+#if HAVE_ZSTD
+	case ZREAD_ZSTD:
+		return zread_zstd(z, buf, sz);
+#endif
+	default:
+		break;
+	}
+
+	while (i < sz) {
+		if (!zread_fill(z))
+			return -1;
+		if (z->eof)
+			break;
+		n = z->insz - z->inoff;
+		if (n > sz - i)
+			n = sz - i;
+		memcpy(buf + i, z->in + z->inoff, n);
+		z->inoff += n;
+		i += n;
+	}
+	return i;
+}
+
+/*
+ * Read the rest of the file into "buf" of size "sz", which is
+ * NUL-terminated and must be freed by the caller.
+ * Return zero on failure, non-zero on success.
+ */
+int
+zread_all(struct zread *z, char **buf, size_t *sz)
+{
+	size_t	 max = ZREAD_CHUNK;
+	ssize_t	 ssz;
+
+	*sz = 0;
+	*buf = xmalloc(max + 1);
+	while ((ssz = zread(z, *buf + *sz, max - *sz)) > 0) {
+		if ((*sz += ssz) < max)
+			continue;
+		if (max > SIZE_MAX / 2 - 1) {
+			ctxwarnx("%s: too large", z->src);
+			break;
+		}
+		max *= 2;
+		*buf = xrealloc(*buf, max + 1);
+	}
+	if (ssz != 0) {
+		free(*buf);
+		*buf = NULL;
+		*sz = 0;
+		return 0;
+	}
+	(*buf)[*sz] = '\0';
+	return 1;
+}
+
+void
+zread_free(struct zread *z)
+{
+
+#if HAVE_ZLIB
+	if (z->type == ZREAD_GZIP) {
+		inflateEnd(z->dec);
+		free(z->dec);
+	}
+#endif
+#if HAVE_ZSTD
+	if (z->type == ZREAD_ZSTD)
+		ZSTD_freeDStream(z->dec);
+#endif
+	free(z->in);
+	z->in = NULL;
+}
+
+/*
+ * Whether "buf" of size "sz" starts with the magic of a compressed
+ * file, which must be read with zread() instead of as-is.
+ */
+int
+zread_magic(const char *buf, size_t sz)
+{
+	const unsigned char	*cp = (const unsigned char *)buf;
+
+	return (sz >= 2 && cp[0] == 0x1f && cp[1] == 0x8b) ||
+		(sz >= 4 && cp[0] == 0x28 && cp[1] == 0xb5 &&
+		 cp[2] == 0x2f && cp[3] == 0xfd);
+}
+
+/*
+ * Copy of "name" without a compression suffix, if any.
+ */
+char *
+zread_name(const char *name)
+{
+	size_t	 i, sz = strlen(name), ssz;
+	char	*cp;
+
+	cp = xstrdup(name);
+	for (i = 0; zsuffixes[i] != NULL; i++) {
+		ssz = strlen(zsuffixes[i]);
+		if (sz > ssz && strcmp(name + sz - ssz, zsuffixes[i]) == 0) {
+			cp[sz - ssz] = '\0';
+			break;
+		}
+	}
+	return cp;
+}